@@ -0,0 +1,282 @@
+/*
+** Cache-set aliasing microbenchmark.
+**
+** Times the propagation pattern of the fused sweep on its own: nine
+** source and nine destination arrays of ny rows of pitch floats, each
+** destination cell reading its population from the neighbouring cell
+** it streams from, three source rows per array. When the arrays are
+** whole multiples of 4 KiB apart, and so are the rows, the 27 source
+** streams and 9 destination streams of a sweep all fall in the same
+** L1 set (and a handful of L2 sets), and each line is evicted before
+** its neighbours are read:
+**
+**   ./d2q9-alias --nx=1024 --ny=1024 --stagger=0,67 --pad=0,1
+**
+** runs every combination of the array stagger (extra cache lines
+** between consecutive array bases, on top of 64 KiB boundaries, as in
+** allocate_grids()) and the row pad (cache lines of padding after each
+** row, as in the sweep-soa-padded kernel), printing the rate for each.
+** Memory comes from one 2 MiB aligned mapping with transparent huge
+** pages requested, like the solver's arena, so the physical addresses
+** do not reshuffle the L2 sets from run to run.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <omp.h>
+
+#define NSPEEDS 9
+#define NARRAYS (2 * NSPEEDS)
+#define LINE_FLOATS 16                      /* floats per 64 byte cache line */
+#define ARRAY_ALIGN ((size_t)64 << 10)      /* array bases as in allocate_grids() */
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+#define MAX_CASES 16
+
+/* struct to hold the benchmark options */
+typedef struct
+{
+  int nx;
+  int ny;
+  int iters;                 /* sweeps per timing */
+  int reps;                  /* timings per case, the best is kept */
+  int staggers[MAX_CASES];   /* array stagger, in cache lines */
+  int nstaggers;
+  int pads[MAX_CASES];       /* row pad, in cache lines */
+  int npads;
+} t_alias_options;
+
+void usage(const char *exe);
+void die(const char *message, const int line, const char *file);
+
+void parse_options(int argc, char *argv[], t_alias_options *options);
+
+/* seconds for the fastest of options->reps runs of options->iters sweeps */
+double time_case(const t_alias_options *options, int stagger, int pad);
+
+int main(int argc, char *argv[])
+{
+  t_alias_options options;
+
+  parse_options(argc, argv, &options);
+
+  printf("%dx%d, %d sweeps x %d, %d threads\n", options.nx, options.ny, options.iters, options.reps,
+         omp_get_max_threads());
+  printf("stagger (lines)  pad (lines)  MLUPS      GB/s\n");
+
+  for (int ss = 0; ss < options.nstaggers; ss++)
+  {
+    for (int pp = 0; pp < options.npads; pp++)
+    {
+      const double seconds = time_case(&options, options.staggers[ss], options.pads[pp]);
+      const double updates = (double)options.nx * options.ny * options.iters;
+
+      /* nine floats loaded and nine stored per update, as Bytes per update counts them */
+      printf("%-16d %-12d %-10.1lf %.2lf\n", options.staggers[ss], options.pads[pp], updates / seconds * 1e-6,
+             updates * 2 * NSPEEDS * sizeof(float) / seconds * 1e-9);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/* one sweep: stream every population of every cell from src into dst */
+static void sweep(const int nx, const int ny, const int pitch, float *src[NSPEEDS], float *dst[NSPEEDS])
+{
+#pragma omp parallel for schedule(static)
+  for (int jj = 0; jj < ny; jj++)
+  {
+    const int row = jj * pitch;
+    const int row_n = (jj == ny - 1) ? 0 : row + pitch;
+    const int row_s = (jj == 0) ? (ny - 1) * pitch : row - pitch;
+    float *restrict s0 = src[0], *restrict s1 = src[1], *restrict s2 = src[2];
+    float *restrict s3 = src[3], *restrict s4 = src[4], *restrict s5 = src[5];
+    float *restrict s6 = src[6], *restrict s7 = src[7], *restrict s8 = src[8];
+    float *restrict d0 = dst[0], *restrict d1 = dst[1], *restrict d2 = dst[2];
+    float *restrict d3 = dst[3], *restrict d4 = dst[4], *restrict d5 = dst[5];
+    float *restrict d6 = dst[6], *restrict d7 = dst[7], *restrict d8 = dst[8];
+
+#pragma omp simd
+    for (int ii = 0; ii < nx; ii++)
+    {
+      const int x_e = (ii == nx - 1) ? 0 : ii + 1;
+      const int x_w = (ii == 0) ? nx - 1 : ii - 1;
+
+      d0[ii + row] = s0[ii + row];
+      d1[ii + row] = s1[x_w + row];
+      d2[ii + row] = s2[ii + row_s];
+      d3[ii + row] = s3[x_e + row];
+      d4[ii + row] = s4[ii + row_n];
+      d5[ii + row] = s5[x_w + row_s];
+      d6[ii + row] = s6[x_e + row_s];
+      d7[ii + row] = s7[x_e + row_n];
+      d8[ii + row] = s8[x_w + row_n];
+    }
+  }
+}
+
+double time_case(const t_alias_options *options, int stagger, int pad)
+{
+  const int pitch = (options->nx + LINE_FLOATS - 1) / LINE_FLOATS * LINE_FLOATS + pad * LINE_FLOATS;
+  const size_t bytes = sizeof(float) * (size_t)pitch * options->ny;
+  const size_t array_pitch = (bytes + ARRAY_ALIGN - 1) / ARRAY_ALIGN * ARRAY_ALIGN + (size_t)stagger * 64;
+  const size_t size = NARRAYS * array_pitch;
+
+  /* map a huge page more than needed, so the arrays can start on a huge page boundary */
+  char *raw = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (raw == MAP_FAILED)
+    die("cannot map memory for the arrays", __LINE__, __FILE__);
+
+  char *base = (char *)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+  madvise(base, size, MADV_HUGEPAGE);
+
+  float *src[NSPEEDS];
+  float *dst[NSPEEDS];
+
+  for (int kk = 0; kk < NSPEEDS; kk++)
+  {
+    src[kk] = (float *)(base + kk * array_pitch);
+    dst[kk] = (float *)(base + (NSPEEDS + kk) * array_pitch);
+  }
+
+  /* first touch by the threads that sweep each row */
+#pragma omp parallel for schedule(static)
+  for (int jj = 0; jj < options->ny; jj++)
+  {
+    for (int kk = 0; kk < NSPEEDS; kk++)
+    {
+      for (int ii = 0; ii < pitch; ii++)
+      {
+        src[kk][ii + jj * pitch] = 1.f / 9.f;
+        dst[kk][ii + jj * pitch] = 0.f;
+      }
+    }
+  }
+
+  double best = 0.0;
+
+  for (int rr = 0; rr < options->reps; rr++)
+  {
+    const double tic = omp_get_wtime();
+
+    for (int tt = 0; tt < options->iters; tt++)
+    {
+      sweep(options->nx, options->ny, pitch, src, dst);
+
+      for (int kk = 0; kk < NSPEEDS; kk++)
+      {
+        float *tmp = src[kk];
+        src[kk] = dst[kk];
+        dst[kk] = tmp;
+      }
+    }
+
+    const double seconds = omp_get_wtime() - tic;
+
+    if (rr == 0 || seconds < best)
+      best = seconds;
+  }
+
+  munmap(raw, size + HUGE_PAGE_SIZE);
+
+  return best;
+}
+
+/* parse a comma separated list of up to MAX_CASES non-negative integers */
+static int parse_list(const char *value, int list[MAX_CASES])
+{
+  int count = 0;
+
+  while (*value != '\0')
+  {
+    char *end;
+    const long number = strtol(value, &end, 10);
+
+    if (end == value || number < 0 || count == MAX_CASES)
+      return -1;
+
+    list[count++] = (int)number;
+    value = (*end == ',') ? end + 1 : end;
+
+    if (*end != ',' && *end != '\0')
+      return -1;
+  }
+
+  return count;
+}
+
+void parse_options(int argc, char *argv[], t_alias_options *options)
+{
+  memset(options, 0, sizeof(*options));
+  options->nx = 1024;
+  options->ny = 1024;
+  options->iters = 20;
+  options->reps = 5;
+  options->staggers[0] = 0;
+  options->staggers[1] = 67;
+  options->nstaggers = 2;
+  options->pads[0] = 0;
+  options->pads[1] = 1;
+  options->npads = 2;
+
+  for (int aa = 1; aa < argc; aa++)
+  {
+    const char *arg = argv[aa];
+    const char *value = strchr(arg, '=');
+
+    if (strncmp(arg, "--", 2) != 0 || value == NULL)
+      usage(argv[0]);
+
+    value++;
+
+    if (strncmp(arg, "--nx=", 5) == 0)
+      options->nx = atoi(value);
+    else if (strncmp(arg, "--ny=", 5) == 0)
+      options->ny = atoi(value);
+    else if (strncmp(arg, "--iters=", 8) == 0)
+      options->iters = atoi(value);
+    else if (strncmp(arg, "--reps=", 7) == 0)
+      options->reps = atoi(value);
+    else if (strncmp(arg, "--stagger=", 10) == 0)
+      options->nstaggers = parse_list(value, options->staggers);
+    else if (strncmp(arg, "--pad=", 6) == 0)
+      options->npads = parse_list(value, options->pads);
+    else
+      usage(argv[0]);
+  }
+
+  if (options->nx < 3 || options->ny < 3)
+    die("--nx and --ny must be at least 3", __LINE__, __FILE__);
+
+  if (options->iters < 1 || options->reps < 1)
+    die("--iters and --reps must be at least 1", __LINE__, __FILE__);
+
+  if (options->nstaggers < 1 || options->npads < 1)
+    die("--stagger and --pad take lists of up to 16 non-negative cache line counts", __LINE__, __FILE__);
+}
+
+void die(const char *message, const int line, const char *file)
+{
+  fprintf(stderr, "Error at line %d of file %s:\n", line, file);
+  fprintf(stderr, "%s\n", message);
+  fflush(stderr);
+  exit(EXIT_FAILURE);
+}
+
+void usage(const char *exe)
+{
+  fprintf(stderr, "Usage: %s [options]\n", exe);
+  fprintf(stderr, "Times the streaming pattern of one sweep for each array stagger and row pad.\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --nx=N --ny=N          grid size (default 1024x1024)\n");
+  fprintf(stderr, "  --iters=N              sweeps per timing (default 20)\n");
+  fprintf(stderr, "  --reps=N               timings per case, the fastest is reported (default 5)\n");
+  fprintf(stderr, "  --stagger=L[,L...]     extra cache lines between array bases (default 0,67)\n");
+  fprintf(stderr, "  --pad=L[,L...]         cache lines of padding after each row (default 0,1)\n");
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,166 @@
+/*
+** Huge-page-backed arena for the lattice.
+**
+** allocate_grids() used to make 21 separate allocations, one per speed
+** array of each grid plus the obstacles, each its own run of 4 KiB
+** pages: a 1024x1024 run touches some 18000 of them every step, far
+** more than the DTLB holds. It now carves everything out of a single
+** mapping, 2 MiB aligned and a whole no. of 2 MiB pages long, backed
+** by huge pages from hugetlbfs (if any are reserved, see
+** /proc/sys/vm/nr_hugepages) or else by transparent huge pages via
+** madvise(MADV_HUGEPAGE), so the same grid needs about 80 TLB entries.
+**
+** D2Q9_HUGE_PAGES=0 in the environment asks for 4 KiB pages instead,
+** to measure the difference.
+**
+** arena_create_arrays() lays arrays out in it with staggered bases: on
+** a power of two grid every speed array is a whole no. of 4 KiB pages
+** long, so arrays placed end to end put cell ii of all 18 in the same
+** L1 set and the sweep evicts lines before it has finished with them.
+** D2Q9_STAGGER=N sets the stagger in cache lines (0 to see the
+** aliasing); alias/d2q9-alias.c measures the effect.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "d2q9-bgk.h"
+
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+#define ARRAY_ALIGN ((size_t)64 << 10) /* arrays start on these boundaries... */
+#define ARRAY_STAGGER_LINES 67          /* ...plus this many cache lines more for each array than the last */
+
+/* struct to hold the arena's own record of itself, at its base */
+typedef struct
+{
+  size_t size; /* bytes mapped */
+  int pages;   /* PAGES_HUGETLB, PAGES_THP or PAGES_SMALL */
+} t_arena;
+
+static size_t round_up(size_t size, size_t multiple)
+{
+  return (size + multiple - 1) / multiple * multiple;
+}
+
+void *arena_create(size_t size)
+{
+  const char *env = getenv("D2Q9_HUGE_PAGES");
+  const int huge = env == NULL || strcmp(env, "0") != 0;
+  int pages = PAGES_HUGETLB;
+
+  size = round_up(size + ARENA_HEADER, HUGE_PAGE_SIZE);
+
+  char *base = huge ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)
+                    : MAP_FAILED;
+
+  if (base == MAP_FAILED)
+  {
+    /* map a huge page more than needed and trim it, so the arena starts on a huge page boundary */
+    char *raw = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (raw == MAP_FAILED)
+      die("cannot map memory for the lattice arena", __LINE__, __FILE__);
+
+    base = (char *)round_up((uintptr_t)raw, HUGE_PAGE_SIZE);
+
+    if (base > raw)
+      munmap(raw, base - raw);
+
+    munmap(base + size, raw + HUGE_PAGE_SIZE - base);
+
+    if (huge && madvise(base, size, MADV_HUGEPAGE) == 0)
+      pages = PAGES_THP;
+    else
+    {
+      madvise(base, size, MADV_NOHUGEPAGE);
+      pages = PAGES_SMALL;
+    }
+  }
+
+  t_arena *arena = (t_arena *)base;
+  arena->size = size;
+  arena->pages = pages;
+
+  return base;
+}
+
+void *arena_create_arrays(size_t head, size_t bytes, int narrays, float **arrays)
+{
+  const char *env = getenv("D2Q9_STAGGER");
+  long lines = ARRAY_STAGGER_LINES;
+
+  if (env != NULL)
+  {
+    char *end;
+    lines = strtol(env, &end, 10);
+
+    if (end == env || *end != '\0' || lines < 0)
+      die("D2Q9_STAGGER must be a no. of cache lines, 0 or more", __LINE__, __FILE__);
+  }
+
+  const size_t array_pitch = round_up(bytes, ARRAY_ALIGN) + (size_t)lines * 64;
+  const size_t first_array = round_up(head, ARRAY_ALIGN);
+  char *base = arena_create(first_array + narrays * array_pitch);
+
+  for (int aa = 0; aa < narrays; aa++)
+    arrays[aa] = (float *)(base + first_array + aa * array_pitch);
+
+  return base;
+}
+
+void arena_destroy(void *base)
+{
+  munmap(base, ((t_arena *)base)->size);
+}
+
+/* AnonHugePages of the mapping starting at base in /proc/self/smaps, in bytes, or -1 */
+static long anon_huge_bytes(const void *base)
+{
+  char line[256];
+  long kib = -1;
+  int found = 0;
+  FILE *fp = fopen("/proc/self/smaps", "r");
+
+  if (fp == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    unsigned long start, end;
+
+    if (sscanf(line, "%lx-%lx", &start, &end) == 2)
+      found = (void *)start == base;
+    else if (found && sscanf(line, "AnonHugePages: %ld kB", &kib) == 1)
+      break;
+  }
+
+  fclose(fp);
+
+  return kib < 0 ? -1 : kib * 1024;
+}
+
+void arena_report(const void *base)
+{
+  const t_arena *arena = base;
+  const double mib = arena->size / 1048576.0;
+
+  if (arena->pages == PAGES_HUGETLB)
+    printf("Lattice memory:\t\t\t\t%.0lf MiB arena, 2 MiB hugetlbfs pages\n", mib);
+  else if (arena->pages == PAGES_THP)
+  {
+    const long huge = anon_huge_bytes(base);
+
+    if (huge >= 0)
+      printf("Lattice memory:\t\t\t\t%.0lf MiB arena, transparent huge pages (%.0lf MiB backed)\n", mib,
+             huge / 1048576.0);
+    else
+      printf("Lattice memory:\t\t\t\t%.0lf MiB arena, transparent huge pages\n", mib);
+  }
+  else
+    printf("Lattice memory:\t\t\t\t%.0lf MiB arena, 4 KiB pages\n", mib);
+}
@@ -0,0 +1,457 @@
+/*
+** Benchmark mode: sweep thread counts, grids and kernel variants.
+**
+**   ./d2q9-bgk --bench --threads=1-4,8 --grids=128x128,1024x1024 --kernels=soa,current
+**
+** Every combination is initialised from input_<grid>.params and
+** obstacles_<grid>.dat, run for a number of warmup steps and then
+** timed over several trials of a fixed no. of steps. The median and
+** standard deviation of the trial MLUPS are reported, along with the
+** parallel efficiency relative to the first thread count listed. The
+** table goes to stdout; --csv and --json write the same results (JSON
+** with the individual trials) for plotting and diffing across commits.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "d2q9-bgk.h"
+
+#define BENCH_MAX_LIST 64      /* most thread counts, grids or kernels in one sweep */
+#define BENCH_MAX_TRIALS 1000  /* most trials per combination */
+#define BENCH_NAME_LEN 64      /* longest grid name */
+
+/* struct to hold the benchmark options */
+typedef struct
+{
+  int threads[BENCH_MAX_LIST];                /* OpenMP thread counts, in the order given */
+  int nthreads;
+  char grids[BENCH_MAX_LIST][BENCH_NAME_LEN]; /* grid names, as in input_<name>.params */
+  int ngrids;
+  const t_kernel *kernels[BENCH_MAX_LIST];    /* kernel variants */
+  int nkernels;
+  int steps;                                  /* timed steps per trial */
+  int warmup;                                 /* untimed steps before the first trial */
+  int trials;                                 /* timed trials per combination */
+  const char *csv_file;                       /* CSV output, NULL for none */
+  const char *json_file;                      /* JSON output, NULL for none */
+} t_bench_options;
+
+/* struct to hold the result of one (grid, kernel, threads) combination */
+typedef struct
+{
+  const char *grid;
+  const t_kernel *kernel;
+  int nx;
+  int ny;
+  int threads;
+  double *mlups;     /* [trials] */
+  double median;
+  double stddev;
+  double min;
+  double max;
+  double efficiency; /* speedup over the first thread count, divided by the thread ratio */
+} t_bench_result;
+
+static void bench_usage(const char *exe)
+{
+  fprintf(stderr, "Usage: %s --bench [options]\n", exe);
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --threads=LIST   OpenMP thread counts, e.g. 1-4,8,16 (default powers of two up to %d)\n", omp_get_max_threads());
+  fprintf(stderr, "  --grids=LIST     grids, read from input_<grid>.params and obstacles_<grid>.dat\n");
+  fprintf(stderr, "                   (default 128x128,128x256,256x256,1024x1024)\n");
+  fprintf(stderr, "  --kernels=LIST   kernel variants, or all (default current)\n");
+  fprintf(stderr, "  --steps=N        timed steps per trial (default 200)\n");
+  fprintf(stderr, "  --warmup=N       untimed steps before the trials (default 50)\n");
+  fprintf(stderr, "  --trials=N       timed trials per combination (default 5)\n");
+  fprintf(stderr, "  --csv=FILE       write the results as CSV\n");
+  fprintf(stderr, "  --json=FILE      write the results, with every trial, as JSON\n");
+  exit(EXIT_FAILURE);
+}
+
+/* parse a comma separated list of positive integers and a-b ranges */
+static int parse_int_list(const char *list, int *values, const char *what)
+{
+  char message[1024];
+  int count = 0;
+  const char *pp = list;
+
+  while (*pp)
+  {
+    char *end;
+    long lo = strtol(pp, &end, 10);
+    long hi = lo;
+
+    if (end != pp && *end == '-')
+    {
+      pp = end + 1;
+      hi = strtol(pp, &end, 10);
+    }
+
+    if (end == pp || (*end != ',' && *end != '\0') || lo < 1 || hi < lo)
+    {
+      sprintf(message, "bad --%s list: %s", what, list);
+      die(message, __LINE__, __FILE__);
+    }
+
+    for (long vv = lo; vv <= hi; vv++)
+    {
+      if (count == BENCH_MAX_LIST)
+      {
+        sprintf(message, "more than %d --%s", BENCH_MAX_LIST, what);
+        die(message, __LINE__, __FILE__);
+      }
+
+      values[count++] = (int)vv;
+    }
+
+    pp = (*end == ',') ? end + 1 : end;
+  }
+
+  return count;
+}
+
+/* split a comma separated list of names, calling add() on each */
+static void parse_name_list(const char *list, t_bench_options *options,
+                            void (*add)(t_bench_options *options, const char *name))
+{
+  char name[BENCH_NAME_LEN];
+  const char *pp = list;
+
+  while (*pp)
+  {
+    size_t len = strcspn(pp, ",");
+
+    if (len == 0 || len >= BENCH_NAME_LEN)
+      die("bad name in --grids or --kernels list", __LINE__, __FILE__);
+
+    memcpy(name, pp, len);
+    name[len] = '\0';
+    add(options, name);
+    pp += len;
+
+    if (*pp == ',')
+      pp++;
+  }
+}
+
+static void add_grid(t_bench_options *options, const char *name)
+{
+  if (options->ngrids == BENCH_MAX_LIST)
+    die("too many --grids", __LINE__, __FILE__);
+
+  strcpy(options->grids[options->ngrids++], name);
+}
+
+static void add_kernel(t_bench_options *options, const char *name)
+{
+  char message[1024];
+
+  if (strcmp(name, "all") == 0)
+  {
+    for (int kk = 0; kk < nkernels && options->nkernels < BENCH_MAX_LIST; kk++)
+      options->kernels[options->nkernels++] = &kernels[kk];
+
+    return;
+  }
+
+  if (options->nkernels == BENCH_MAX_LIST)
+    die("too many --kernels", __LINE__, __FILE__);
+
+  options->kernels[options->nkernels] = find_kernel(name);
+
+  if (options->kernels[options->nkernels] == NULL)
+  {
+    sprintf(message, "unknown kernel: %s (see --list-kernels)", name);
+    die(message, __LINE__, __FILE__);
+  }
+
+  options->nkernels++;
+}
+
+static void parse_bench_options(int argc, char *argv[], t_bench_options *options)
+{
+  memset(options, 0, sizeof(*options));
+  options->steps = 200;
+  options->warmup = 50;
+  options->trials = 5;
+
+  /* argv[1] is --bench */
+  for (int aa = 2; aa < argc; aa++)
+  {
+    if (strncmp(argv[aa], "--threads=", 10) == 0)
+      options->nthreads = parse_int_list(argv[aa] + 10, options->threads, "threads");
+    else if (strncmp(argv[aa], "--grids=", 8) == 0)
+      parse_name_list(argv[aa] + 8, options, add_grid);
+    else if (strncmp(argv[aa], "--kernels=", 10) == 0)
+      parse_name_list(argv[aa] + 10, options, add_kernel);
+    else if (strncmp(argv[aa], "--steps=", 8) == 0)
+      options->steps = atoi(argv[aa] + 8);
+    else if (strncmp(argv[aa], "--warmup=", 9) == 0)
+      options->warmup = atoi(argv[aa] + 9);
+    else if (strncmp(argv[aa], "--trials=", 9) == 0)
+      options->trials = atoi(argv[aa] + 9);
+    else if (strncmp(argv[aa], "--csv=", 6) == 0)
+      options->csv_file = argv[aa] + 6;
+    else if (strncmp(argv[aa], "--json=", 7) == 0)
+      options->json_file = argv[aa] + 7;
+    else
+      bench_usage(argv[0]);
+  }
+
+  if (options->steps < 1 || options->warmup < 0 || options->trials < 1 || options->trials > BENCH_MAX_TRIALS)
+    die("--steps and --trials must be positive and --warmup not negative", __LINE__, __FILE__);
+
+  if (options->nthreads == 0)
+  {
+    const int max_threads = omp_get_max_threads();
+
+    for (int tt = 1; tt < max_threads; tt *= 2)
+      options->threads[options->nthreads++] = tt;
+
+    options->threads[options->nthreads++] = max_threads;
+  }
+
+  if (options->ngrids == 0)
+    parse_name_list("128x128,128x256,256x256,1024x1024", options, add_grid);
+
+  if (options->nkernels == 0)
+    add_kernel(options, "current");
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+  const double x = *(const double *)a;
+  const double y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* run the warmup and timed trials of one combination, filling in result->mlups and its statistics */
+static void bench_run(const t_bench_options *options, const char *grid, const t_kernel *kernel, int threads,
+                      t_bench_result *result)
+{
+  char paramfile[BENCH_NAME_LEN + 32];
+  char obstaclefile[BENCH_NAME_LEN + 32];
+  t_options init_options;
+  t_param params;
+  t_speed *cells = NULL;
+  t_speed *tmp_cells = NULL;
+  int *obstacles = NULL;
+  float *av_vels = NULL;
+  void *grid_cells = NULL;
+  void *grid_tmp_cells = NULL;
+  double sorted[BENCH_MAX_TRIALS];
+
+  sprintf(paramfile, "input_%s.params", grid);
+  sprintf(obstaclefile, "obstacles_%s.dat", grid);
+
+  /* set, and the threads pinned, before initialise() so its first touch matches the run */
+  omp_set_num_threads(threads);
+  numa_pin_threads();
+
+  memset(&init_options, 0, sizeof(init_options));
+  init_options.kernel = kernel;
+  initialise(paramfile, obstaclefile, &init_options, &params, &cells, &tmp_cells, &obstacles, &av_vels);
+  kernel = kernel_for_grid(kernel, params);
+  kernel_grids_open(kernel, params, cells, tmp_cells, obstacles, &grid_cells, &grid_tmp_cells);
+
+  for (int tt = 0; tt < options->warmup; tt++)
+    kernel->step(params, &grid_cells, &grid_tmp_cells, obstacles);
+
+  for (int trial = 0; trial < options->trials; trial++)
+  {
+    const double tic = monotonic_clock();
+
+    for (int tt = 0; tt < options->steps; tt++)
+      kernel->step(params, &grid_cells, &grid_tmp_cells, obstacles);
+
+    const double toc = monotonic_clock();
+    result->mlups[trial] = (double)params.nx * params.ny * options->steps / (toc - tic) / 1.0e6;
+  }
+
+  kernel_grids_close(kernel, params, &cells, &tmp_cells, grid_cells, grid_tmp_cells);
+  finalise(&params, &cells, &tmp_cells, &obstacles, &av_vels);
+
+  result->grid = grid;
+  result->kernel = kernel;
+  result->nx = params.nx;
+  result->ny = params.ny;
+  result->threads = threads;
+
+  memcpy(sorted, result->mlups, sizeof(double) * options->trials);
+  qsort(sorted, options->trials, sizeof(double), compare_doubles);
+
+  const int mid = options->trials / 2;
+  result->median = (options->trials % 2) ? sorted[mid] : 0.5 * (sorted[mid - 1] + sorted[mid]);
+  result->min = sorted[0];
+  result->max = sorted[options->trials - 1];
+
+  double mean = 0.0;
+  double var = 0.0;
+
+  for (int trial = 0; trial < options->trials; trial++)
+    mean += result->mlups[trial] / options->trials;
+
+  for (int trial = 0; trial < options->trials; trial++)
+    var += (result->mlups[trial] - mean) * (result->mlups[trial] - mean);
+
+  result->stddev = (options->trials > 1) ? sqrt(var / (options->trials - 1)) : 0.0;
+}
+
+static void bench_write_csv(const t_bench_options *options, const t_bench_result *results, int nresults)
+{
+  FILE *fp = fopen(options->csv_file, "w");
+
+  if (fp == NULL)
+    die("could not open benchmark CSV file", __LINE__, __FILE__);
+
+  fprintf(fp, "grid,kernel,nx,ny,threads,steps,trials,median_mlups,stddev_mlups,min_mlups,max_mlups,efficiency\n");
+
+  for (int rr = 0; rr < nresults; rr++)
+  {
+    const t_bench_result *result = &results[rr];
+
+    fprintf(fp, "%s,%s,%d,%d,%d,%d,%d,%.3lf,%.3lf,%.3lf,%.3lf,%.4lf\n",
+            result->grid, result->kernel->name, result->nx, result->ny, result->threads,
+            options->steps, options->trials, result->median, result->stddev, result->min, result->max,
+            result->efficiency);
+  }
+
+  fclose(fp);
+}
+
+static void bench_write_json(const t_bench_options *options, const t_bench_result *results, int nresults,
+                             const char *cpu)
+{
+  FILE *fp = fopen(options->json_file, "w");
+
+  if (fp == NULL)
+    die("could not open benchmark JSON file", __LINE__, __FILE__);
+
+  fprintf(fp, "{\"cpu\": \"%s\", \"procs\": %d, \"steps\": %d, \"warmup\": %d, \"trials\": %d, \"results\": [\n",
+          cpu, omp_get_num_procs(), options->steps, options->warmup, options->trials);
+
+  for (int rr = 0; rr < nresults; rr++)
+  {
+    const t_bench_result *result = &results[rr];
+
+    fprintf(fp, "  {\"grid\": \"%s\", \"kernel\": \"%s\", \"nx\": %d, \"ny\": %d, \"threads\": %d, "
+                "\"median_mlups\": %.3lf, \"stddev_mlups\": %.3lf, \"min_mlups\": %.3lf, \"max_mlups\": %.3lf, "
+                "\"efficiency\": %.4lf, \"bytes_per_update\": %d, \"mlups\": [",
+            result->grid, result->kernel->name, result->nx, result->ny, result->threads,
+            result->median, result->stddev, result->min, result->max, result->efficiency,
+            result->kernel->bytes_per_update);
+
+    for (int trial = 0; trial < options->trials; trial++)
+      fprintf(fp, "%s%.3lf", trial ? ", " : "", result->mlups[trial]);
+
+    fprintf(fp, "]}%s\n", (rr < nresults - 1) ? "," : "");
+  }
+
+  fprintf(fp, "]}\n");
+  fclose(fp);
+}
+
+void cpu_model(char *model, int size)
+{
+  char line[1024];
+  FILE *fp = fopen("/proc/cpuinfo", "r");
+
+  snprintf(model, size, "unknown");
+
+  if (fp == NULL)
+    return;
+
+  while (fgets(line, sizeof(line), fp))
+  {
+    if (strncmp(line, "model name", 10) == 0)
+    {
+      char *value = strchr(line, ':');
+
+      if (value == NULL)
+        break;
+
+      value += strspn(value, ": \t");
+      value[strcspn(value, "\n")] = '\0';
+      snprintf(model, size, "%s", value);
+      break;
+    }
+  }
+
+  fclose(fp);
+}
+
+int bench(int argc, char *argv[])
+{
+  t_bench_options options;
+  char cpu[256];
+
+  parse_bench_options(argc, argv, &options);
+  cpu_model(cpu, sizeof(cpu));
+
+  const int nresults = options.ngrids * options.nkernels * options.nthreads;
+  t_bench_result *results = (t_bench_result *)calloc(nresults, sizeof(t_bench_result));
+  double *mlups = (double *)malloc(sizeof(double) * nresults * options.trials);
+
+  if (results == NULL || mlups == NULL)
+    die("cannot allocate memory for benchmark results", __LINE__, __FILE__);
+
+#ifdef PROFILE_PHASES
+  /* current_step() records its phases whatever the caller */
+  int max_threads = omp_get_max_threads();
+
+  for (int tt = 0; tt < options.nthreads; tt++)
+    max_threads = (options.threads[tt] > max_threads) ? options.threads[tt] : max_threads;
+
+  profile_init(max_threads);
+#endif
+
+  printf("CPU: %s\n", cpu);
+  printf("%d warmup steps, %d trials of %d steps\n", options.warmup, options.trials, options.steps);
+  printf("%-12s %-22s %8s %14s %10s %10s\n", "grid", "kernel", "threads", "median MLUPS", "stddev", "efficiency");
+
+  int rr = 0;
+
+  for (int gg = 0; gg < options.ngrids; gg++)
+  {
+    for (int kk = 0; kk < options.nkernels; kk++)
+    {
+      const t_bench_result *base = &results[rr];
+
+      for (int tt = 0; tt < options.nthreads; tt++, rr++)
+      {
+        t_bench_result *result = &results[rr];
+
+        result->mlups = &mlups[rr * options.trials];
+        bench_run(&options, options.grids[gg], options.kernels[kk], options.threads[tt], result);
+
+        /* the first thread count of each (grid, kernel) is the baseline */
+        result->efficiency = (result->median / base->median) * ((double)base->threads / result->threads);
+
+        printf("%-12s %-22s %8d %14.3lf %10.3lf %10.3lf\n", result->grid, result->kernel->name,
+               result->threads, result->median, result->stddev, result->efficiency);
+        fflush(stdout);
+      }
+    }
+  }
+
+  if (options.csv_file)
+    bench_write_csv(&options, results, nresults);
+
+  if (options.json_file)
+    bench_write_json(&options, results, nresults, cpu);
+
+#ifdef PROFILE_PHASES
+  profile_free();
+#endif
+  free(mlups);
+  free(results);
+
+  return EXIT_SUCCESS;
+}
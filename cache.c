@@ -0,0 +1,192 @@
+/*
+** Content-addressed result cache.
+**
+** With --result-cache=DIR the solver hashes everything its output
+** depends on: the build (sources, compiler and flags), the parsed
+** parameters, the obstacle mask, the kernel variant, the OpenMP thread
+** count and schedule (the av_vels reduction order depends on them, and
+** on whether sweep-soa-nt streams) and the options that change when the
+** time loop stops or how it starts. A run whose key is already in DIR
+** copies the cached final_state.dat and av_vels.dat into place and skips
+** the simulation; any other run stores its output there when it finishes.
+**
+** Entries are DIR/<key>.final_state.dat and DIR/<key>.av_vels.dat,
+** plus DIR/<key>.key, a readable list of what went into the key. They
+** are written to temporary files and renamed into place, so concurrent
+** jobs sharing a cache never see a partial entry.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "d2q9-bgk.h"
+
+#define CACHE_PATH_LEN 4096
+
+/* the Makefile passes a checksum of the sources, compiler and flags; other builds use the time they were built */
+#ifndef D2Q9_BUILD_ID
+#define D2Q9_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+/* 64 bit FNV-1a, continuing from hash */
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+{
+  const unsigned char *bytes = data;
+
+  for (size_t ii = 0; ii < size; ii++)
+  {
+    hash ^= bytes[ii];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+/* the key fields, in the order they are hashed and listed in the .key file */
+static int describe(const t_param params, const t_options *options, char *text, int size)
+{
+  omp_sched_t schedule;
+  int chunk;
+  int streaming = 0;
+  int warm_start_streaming = 0;
+
+  omp_get_schedule(&schedule, &chunk);
+
+  /* which sweep sweep-soa-nt runs, for this grid and the coarse one of the warm start */
+  if (options->kernel->step == sweep_soa_nt_step)
+  {
+    t_param coarse = params;
+
+    streaming = sweep_soa_nt_streams(params);
+
+    if (options->warm_start > 0)
+    {
+      coarse.nx = params.nx / options->warm_start;
+      coarse.ny = params.ny / options->warm_start;
+      warm_start_streaming = sweep_soa_nt_streams(coarse);
+    }
+  }
+
+  return snprintf(text, size,
+                  "build %s\n"
+                  "nx %d\nny %d\nmaxIters %d\nreynolds_dim %d\ndensity %a\naccel %a\nomega %a\n"
+                  "kernel %s\nthreads %d\nschedule %s\nchunk %d\n"
+                  "converge %a\nconverge_window %d\nconverge_stride %d\nwarm_start %d\nwarm_start_iters %d\n"
+                  "streaming %d\nwarm_start_streaming %d\n",
+                  D2Q9_BUILD_ID, params.nx, params.ny, params.maxIters, params.reynolds_dim,
+                  params.density, params.accel, params.omega,
+                  options->kernel->name, omp_get_max_threads(), schedule_name(schedule), chunk,
+                  options->converge_tol, options->converge_window, options->converge_stride,
+                  options->warm_start, options->warm_start_iters, streaming, warm_start_streaming);
+}
+
+void result_key(const t_param params, const int *obstacles, const t_options *options, char *key)
+{
+  char text[1024];
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  describe(params, options, text, sizeof(text));
+  hash = fnv1a(hash, text, strlen(text));
+
+  /* the mask, not the int array, so the key does not depend on the blocked value stored */
+  for (int ii = 0; ii < params.nx * params.ny; ii++)
+  {
+    const unsigned char blocked = obstacles[ii] != 0;
+    hash = fnv1a(hash, &blocked, 1);
+  }
+
+  sprintf(key, "%016llx", (unsigned long long)hash);
+}
+
+/* copy src to dst through dst.tmp, returning 0 on failure */
+static int copy_file(const char *src, const char *dst)
+{
+  char tmp[CACHE_PATH_LEN];
+  char buf[1 << 16];
+  size_t nread;
+  int ok = 1;
+
+  FILE *in = fopen(src, "rb");
+
+  if (in == NULL)
+    return 0;
+
+  snprintf(tmp, sizeof(tmp), "%s.%d.tmp", dst, (int)getpid());
+  FILE *out = fopen(tmp, "wb");
+
+  if (out == NULL)
+  {
+    fclose(in);
+    return 0;
+  }
+
+  while ((nread = fread(buf, 1, sizeof(buf), in)) > 0)
+    ok = ok && fwrite(buf, 1, nread, out) == nread;
+
+  ok = ok && !ferror(in);
+  fclose(in);
+  ok = (fclose(out) == 0) && ok;
+  ok = ok && rename(tmp, dst) == 0;
+
+  if (!ok)
+    remove(tmp);
+
+  return ok;
+}
+
+int result_fetch(const char *dir, const char *key)
+{
+  char final_state[CACHE_PATH_LEN];
+  char av_vels[CACHE_PATH_LEN];
+
+  snprintf(final_state, sizeof(final_state), "%s/%s.%s", dir, key, FINALSTATEFILE);
+  snprintf(av_vels, sizeof(av_vels), "%s/%s.%s", dir, key, AVVELSFILE);
+
+  /* the av_vels go in last, so an entry with both files is complete */
+  if (access(av_vels, R_OK) != 0 || access(final_state, R_OK) != 0)
+    return 0;
+
+  return copy_file(final_state, FINALSTATEFILE) && copy_file(av_vels, AVVELSFILE);
+}
+
+void result_store(const char *dir, const char *key, const t_param params, const t_options *options)
+{
+  char path[CACHE_PATH_LEN];
+  char text[1024];
+
+  if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+  {
+    fprintf(stderr, "warning: could not create result cache %s\n", dir);
+    return;
+  }
+
+  snprintf(path, sizeof(path), "%s/%s.key", dir, key);
+  FILE *fp = fopen(path, "w");
+
+  if (fp != NULL)
+  {
+    describe(params, options, text, sizeof(text));
+    fputs(text, fp);
+    fclose(fp);
+  }
+
+  snprintf(path, sizeof(path), "%s/%s.%s", dir, key, FINALSTATEFILE);
+
+  if (copy_file(FINALSTATEFILE, path))
+  {
+    snprintf(path, sizeof(path), "%s/%s.%s", dir, key, AVVELSFILE);
+
+    if (copy_file(AVVELSFILE, path))
+      return;
+  }
+
+  fprintf(stderr, "warning: could not store results in cache %s\n", dir);
+}
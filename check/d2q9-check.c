@@ -0,0 +1,430 @@
+/*
+** Native replacement for check.py.
+**
+** Compares the av_vels and final_state output of a d2q9-bgk run against
+** reference results, printing the same total/biggest difference
+** statistics as check.py and exiting with 1 if either file is outside
+** the percentage tolerance.
+**
+** The four files are mmapped and each one is parsed by all threads at
+** once: the mapping is split into equal byte ranges, each range is
+** snapped forward to a line start, the lines in each range are counted
+** and a prefix sum over the counts gives every thread the output
+** offset for its values.
+**
+**   ./d2q9-check [--tolerance=1] --ref-av-vels-file=FILE
+**                --ref-final-state-file=FILE --av-vels-file=FILE
+**                --final-state-file=FILE
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
+
+#define MAXCOLS 3 /* most columns used from any file */
+
+/* struct to hold the selected columns of a results file */
+typedef struct
+{
+  long nrows;           /* no. of data lines */
+  int ncols;            /* no. of columns kept */
+  double *cols[MAXCOLS]; /* one array of nrows values per kept column */
+} t_table;
+
+/* struct to hold the comparison of one column, as in check.py */
+typedef struct
+{
+  long max_diff_step; /* row with the largest percentage difference */
+  double max_diff;    /* ref - sim at that row */
+  double max_diff_pcnt;
+  double sim_val;
+  double ref_val;
+  double total;       /* sum of |ref - sim| */
+} t_diffs;
+
+/* map a file and parse the whitespace separated columns listed in usecols */
+void load_table(const char *filename, const int *usecols, int ncols, t_table *table);
+void free_table(t_table *table);
+
+/* compare two columns of equal length */
+void get_diff_values(const double *ref_vals, const double *sim_vals, long n, t_diffs *diffs);
+int failed(const t_diffs *diffs, double tolerance);
+
+void die(const char *message, const char *detail);
+void usage(const char *exe);
+
+int main(int argc, char *argv[])
+{
+  const char *ref_av_vels_file = NULL;
+  const char *ref_final_state_file = NULL;
+  const char *av_vels_file = NULL;
+  const char *final_state_file = NULL;
+  double tolerance = 1.0; /* percentage tolerance to match against reference results */
+
+  /* accept both --opt=value and --opt value, like argparse */
+  for (int aa = 1; aa < argc; aa++)
+  {
+    const char *arg = argv[aa];
+    const char *value = strchr(arg, '=');
+    size_t len = value ? (size_t)(value - arg) : strlen(arg);
+
+    if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+      usage(argv[0]);
+
+    if (value)
+      value++;
+    else if (aa + 1 < argc)
+      value = argv[++aa];
+    else
+      usage(argv[0]);
+
+    if (len == 11 && strncmp(arg, "--tolerance", len) == 0)
+      tolerance = atof(value);
+    else if (len == 18 && strncmp(arg, "--ref-av-vels-file", len) == 0)
+      ref_av_vels_file = value;
+    else if (len == 22 && strncmp(arg, "--ref-final-state-file", len) == 0)
+      ref_final_state_file = value;
+    else if (len == 14 && strncmp(arg, "--av-vels-file", len) == 0)
+      av_vels_file = value;
+    else if (len == 18 && strncmp(arg, "--final-state-file", len) == 0)
+      final_state_file = value;
+    else
+      usage(argv[0]);
+  }
+
+  if (!ref_av_vels_file || !ref_final_state_file || !av_vels_file || !final_state_file)
+    usage(argv[0]);
+
+  const int av_vels_cols[] = {1};
+  const int final_state_cols[] = {0, 1, 5};
+  t_table av_vels_ref, final_state_ref, av_vels_sim, final_state_sim;
+
+  load_table(ref_av_vels_file, av_vels_cols, 1, &av_vels_ref);
+  load_table(ref_final_state_file, final_state_cols, 3, &final_state_ref);
+  load_table(av_vels_file, av_vels_cols, 1, &av_vels_sim);
+  load_table(final_state_file, final_state_cols, 3, &final_state_sim);
+
+  /* Make sure the coordinates are in the right order */
+  int coords_differ = final_state_ref.nrows != final_state_sim.nrows;
+
+#pragma omp parallel for reduction(| \
+                                   : coords_differ)
+  for (long ii = 0; ii < (coords_differ ? 0 : final_state_ref.nrows); ii++)
+  {
+    coords_differ |= final_state_ref.cols[0][ii] != final_state_sim.cols[0][ii] ||
+                     final_state_ref.cols[1][ii] != final_state_sim.cols[1][ii];
+  }
+
+  if (coords_differ)
+  {
+    printf("Final state files coordinates were not the same\n");
+    return 1;
+  }
+
+  /* Make sure the av_vels have the same number of steps */
+  if (av_vels_ref.nrows != av_vels_sim.nrows)
+  {
+    printf("Different number of steps in av_vels files\n");
+    return 1;
+  }
+
+  t_diffs av_vels_diffs, final_state_diffs;
+
+  get_diff_values(av_vels_ref.cols[0], av_vels_sim.cols[0], av_vels_ref.nrows, &av_vels_diffs);
+  printf("Total difference in av_vels : %.12E\n", av_vels_diffs.total);
+  printf("Biggest difference (at step %ld) : %.12E\n", av_vels_diffs.max_diff_step, av_vels_diffs.max_diff);
+  printf("  %.12E vs. %.12E = %.2g%%\n", av_vels_diffs.sim_val, av_vels_diffs.ref_val, av_vels_diffs.max_diff_pcnt);
+  printf("\n");
+
+  get_diff_values(final_state_ref.cols[2], final_state_sim.cols[2], final_state_ref.nrows, &final_state_diffs);
+
+  /* We want the location of the biggest difference */
+  const long loc = final_state_diffs.max_diff_step;
+
+  printf("Total difference in final_state : %.12E\n", final_state_diffs.total);
+  printf("Biggest difference (at coord (%d,%d)) : %.12E\n",
+         (int)final_state_sim.cols[0][loc], (int)final_state_sim.cols[1][loc], final_state_diffs.max_diff);
+  printf("  %.12E vs. %.12E = %.2g%%\n", final_state_diffs.sim_val, final_state_diffs.ref_val, final_state_diffs.max_diff_pcnt);
+  printf("\n");
+
+  /* Find out if either of them failed */
+  const int final_state_failed = failed(&final_state_diffs, tolerance);
+  const int av_vels_failed = failed(&av_vels_diffs, tolerance);
+
+  if (final_state_failed)
+    printf("final state failed check\n");
+  if (av_vels_failed)
+    printf("av_vels failed check\n");
+
+  free_table(&av_vels_ref);
+  free_table(&final_state_ref);
+  free_table(&av_vels_sim);
+  free_table(&final_state_sim);
+
+  /* Return 1 on failure */
+  if (final_state_failed || av_vels_failed)
+    return 1;
+
+  printf("Both tests passed!\n");
+  return 0;
+}
+
+/*
+** Parse the lines starting in [begin, end). Blank lines and '#' comments
+** are skipped, as np.loadtxt does. With a NULL table the lines are only
+** counted. Returns the no. of data lines, or -1 on a malformed line.
+*/
+static long parse_range(const char *buf, size_t size, size_t begin, size_t end,
+                        const int *usecols, int ncols, t_table *table, long row)
+{
+  const int maxcol = usecols[ncols - 1];
+  long nlines = 0;
+  size_t pos = begin;
+
+  while (pos < end)
+  {
+    const char *line = buf + pos;
+    const char *eol = memchr(line, '\n', size - pos);
+    const size_t len = eol ? (size_t)(eol - line) : size - pos;
+    size_t cc = 0;
+
+    pos += len + 1;
+
+    while (cc < len && (line[cc] == ' ' || line[cc] == '\t' || line[cc] == '\r'))
+      cc++;
+
+    if (cc == len || line[cc] == '#')
+      continue;
+
+    if (table != NULL)
+    {
+      int kk = 0;
+
+      for (int col = 0; col <= maxcol; col++)
+      {
+        while (cc < len && (line[cc] == ' ' || line[cc] == '\t'))
+          cc++;
+
+        if (cc == len)
+          return -1;
+
+        const size_t start = cc;
+
+        while (cc < len && line[cc] != ' ' && line[cc] != '\t' && line[cc] != '\r')
+          cc++;
+
+        if (col == usecols[kk])
+        {
+          char field[64];
+          char *field_end;
+          const size_t flen = cc - start;
+
+          if (flen >= sizeof(field))
+            return -1;
+
+          memcpy(field, line + start, flen);
+          field[flen] = '\0';
+          table->cols[kk][row + nlines] = strtod(field, &field_end);
+
+          if (field_end == field)
+            return -1;
+
+          kk++;
+        }
+      }
+    }
+
+    nlines++;
+  }
+
+  return nlines;
+}
+
+void load_table(const char *filename, const int *usecols, int ncols, t_table *table)
+{
+  struct stat st;
+  int fd = open(filename, O_RDONLY);
+
+  if (fd < 0 || fstat(fd, &st) != 0)
+    die("could not open file", filename);
+
+  const size_t size = st.st_size;
+  const char *buf = "";
+
+  if (size > 0)
+  {
+    buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (buf == MAP_FAILED)
+      die("could not map file", filename);
+
+    posix_madvise((void *)buf, size, POSIX_MADV_SEQUENTIAL);
+  }
+
+  close(fd);
+
+  const int nthreads = omp_get_max_threads();
+  size_t *starts = malloc(sizeof(size_t) * (nthreads + 1));
+  long *offsets = malloc(sizeof(long) * (nthreads + 1));
+  int bad = 0;
+
+  if (starts == NULL || offsets == NULL)
+    die("cannot allocate memory for line offsets", filename);
+
+  /* snap equal byte ranges forward to the next line start */
+  for (int tt = 0; tt < nthreads; tt++)
+  {
+    size_t pos = size / nthreads * tt;
+
+    /* pos is 0 for every thread when the file has fewer bytes than there are threads */
+    if (tt > 0 && pos > 0)
+    {
+      const char *eol = memchr(buf + pos - 1, '\n', size - pos + 1);
+      pos = eol ? (size_t)(eol - buf) + 1 : size;
+    }
+
+    starts[tt] = pos;
+  }
+
+  starts[nthreads] = size;
+
+#pragma omp parallel num_threads(nthreads)
+  {
+    const int tt = omp_get_thread_num();
+    const size_t begin = starts[tt];
+    const size_t end = starts[tt + 1] > begin ? starts[tt + 1] : begin;
+
+    offsets[tt + 1] = parse_range(buf, size, begin, end, usecols, ncols, NULL, 0);
+
+#pragma omp barrier
+#pragma omp single
+    {
+      offsets[0] = 0;
+
+      for (int kk = 1; kk <= nthreads; kk++)
+        offsets[kk] += offsets[kk - 1];
+
+      table->nrows = offsets[nthreads];
+      table->ncols = ncols;
+
+      for (int kk = 0; kk < ncols; kk++)
+      {
+        table->cols[kk] = malloc(sizeof(double) * (table->nrows > 0 ? table->nrows : 1));
+
+        if (table->cols[kk] == NULL)
+          die("cannot allocate memory for columns", filename);
+      }
+    }
+
+    if (parse_range(buf, size, begin, end, usecols, ncols, table, offsets[tt]) < 0)
+    {
+#pragma omp atomic write
+      bad = 1;
+    }
+  }
+
+  if (bad)
+    die("could not parse file", filename);
+
+  if (size > 0)
+    munmap((void *)buf, size);
+
+  free(starts);
+  free(offsets);
+}
+
+void free_table(t_table *table)
+{
+  for (int kk = 0; kk < table->ncols; kk++)
+    free(table->cols[kk]);
+}
+
+void get_diff_values(const double *ref_vals, const double *sim_vals, long n, t_diffs *diffs)
+{
+  double total = 0.0;
+  double best = -1.0; /* largest |diff_pcnt| seen, NaN wins like np.argmax */
+  long best_step = 0;
+
+  if (n == 0)
+    die("no values to compare", "");
+
+#pragma omp parallel
+  {
+    double my_best = -1.0;
+    long my_step = n;
+
+#pragma omp for reduction(+ \
+                          : total) nowait
+    for (long ii = 0; ii < n; ii++)
+    {
+      /* Get the differences between the original and reference results */
+      const double diff = ref_vals[ii] - sim_vals[ii];
+      const double pcnt = fabs(100.0 * (diff / (ref_vals[ii] - diff)));
+
+      total += fabs(diff);
+
+      if (my_best != my_best)
+        continue;
+
+      if (pcnt != pcnt || pcnt > my_best)
+      {
+        my_best = pcnt;
+        my_step = ii;
+      }
+    }
+
+    /* keep the first occurrence of the maximum, as np.argmax does */
+#pragma omp critical
+    {
+      const int my_nan = my_best != my_best;
+      const int best_nan = best != best;
+
+      if (my_step < n &&
+          ((my_nan && (!best_nan || my_step < best_step)) ||
+           (!my_nan && !best_nan && (my_best > best || (my_best == best && my_step < best_step)))))
+      {
+        best = my_best;
+        best_step = my_step;
+      }
+    }
+  }
+
+  const double diff = ref_vals[best_step] - sim_vals[best_step];
+
+  diffs->max_diff_step = best_step;
+  diffs->max_diff = diff;
+  diffs->max_diff_pcnt = 100.0 * (diff / (ref_vals[best_step] - diff));
+  diffs->sim_val = sim_vals[best_step];
+  diffs->ref_val = ref_vals[best_step];
+  diffs->total = total;
+}
+
+int failed(const t_diffs *diffs, double tolerance)
+{
+  return !isfinite(diffs->max_diff_pcnt) || fabs(diffs->max_diff_pcnt) > tolerance;
+}
+
+void die(const char *message, const char *detail)
+{
+  fprintf(stderr, "%s: %s\n", message, detail);
+  exit(2);
+}
+
+void usage(const char *exe)
+{
+  fprintf(stderr, "usage: %s [--tolerance TOLERANCE] --ref-av-vels-file REF_AV_VELS_FILE\n"
+                  "       --ref-final-state-file REF_FINAL_STATE_FILE --av-vels-file AV_VELS_FILE\n"
+                  "       --final-state-file FINAL_STATE_FILE\n\n"
+                  "Testing script for HPC LBM coursework\n\n"
+                  "  --tolerance TOLERANCE   Percentage tolerance to match against reference results (default: 1)\n",
+          exe);
+  exit(2);
+}
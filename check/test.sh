@@ -0,0 +1,242 @@
+#!/bin/sh
+#
+# Behaviour tests, run by make check-test from the top directory:
+#
+#  - d2q9-check's file splitting: files with fewer bytes than there are
+#    threads, and empty files
+#  - the 128x128 problem against its reference output
+#  - every BGK kernel variant against current
+#  - every obstacle file format against the text one
+#  - --stream-av-vels, --result-cache and --serve/--submit against a plain run
+#  - libd2q9, through python/d2q9.py, against a plain run (if numpy is installed)
+#
+# All but the reference run are shortened to TEST_ITERS steps (default
+# 1000), so the serial ported kernels do not take minutes each.
+#
+#   check/test.sh [./d2q9-check [./d2q9-bgk [./d2q9-gen]]]
+
+absolute()
+{
+  echo "$(cd "$(dirname "$1")" && pwd)/$(basename "$1")"
+}
+
+CHECK=$(absolute "${1:-./d2q9-check}")
+BGK=$(absolute "${2:-./d2q9-bgk}")
+GEN=$(absolute "${3:-./d2q9-gen}")
+ITERS=${TEST_ITERS:-1000}
+TOP=$(pwd)
+DIR=$(mktemp -d)
+FAILED=0
+
+trap 'rm -rf "$DIR"' EXIT
+
+pass()
+{
+  echo "ok: $1"
+}
+
+fail()
+{
+  echo "FAILED: $1"
+  [ -n "$2" ] && cat "$2"
+  FAILED=1
+}
+
+# expect STATUS NAME REF_AV_VELS REF_FINAL_STATE AV_VELS FINAL_STATE: d2q9-check with 8 threads
+expect()
+{
+  OMP_NUM_THREADS=8 "$CHECK" --ref-av-vels-file="$3" --ref-final-state-file="$4" \
+    --av-vels-file="$5" --final-state-file="$6" > "$DIR/out" 2>&1
+  status=$?
+
+  if [ "$status" -eq "$1" ]; then
+    pass "$2"
+  else
+    fail "$2 (exit $status, expected $1)" "$DIR/out"
+  fi
+}
+
+# matches NAME REF OUT: the output of run OUT is within d2q9-check's tolerance of that of run REF
+matches()
+{
+  expect 0 "$1" "$DIR/$2/av_vels.dat" "$DIR/$2/final_state.dat" "$DIR/$3/av_vels.dat" "$DIR/$3/final_state.dat"
+}
+
+# identical NAME REF OUT: the output of run OUT is byte for byte that of run REF
+identical()
+{
+  if cmp -s "$DIR/$2/av_vels.dat" "$DIR/$3/av_vels.dat" && cmp -s "$DIR/$2/final_state.dat" "$DIR/$3/final_state.dat"; then
+    pass "$1"
+  else
+    fail "$1 (output differs from $2)"
+  fi
+}
+
+# run NAME ARGS...: d2q9-bgk ARGS in $DIR/NAME, returning nonzero (and failing) if it does
+run()
+{
+  name=$1
+  shift
+  mkdir -p "$DIR/$name"
+
+  if ! (cd "$DIR/$name" && "$BGK" "$@") > "$DIR/$name.log" 2>&1; then
+    fail "d2q9-bgk $*" "$DIR/$name.log"
+    return 1
+  fi
+}
+
+# pnm TEXT P1|P2: the text obstacles of a nx x ny grid as a plain PBM or PGM image, top row first
+pnm()
+{
+  awk -v nx="$nx" -v ny="$ny" -v kind="$2" '
+    { blocked[$1, $2] = $3 }
+    END {
+      print kind
+      print nx, ny
+      if (kind == "P2")
+        print 255
+      for (row = ny - 1; row >= 0; row--) {
+        line = ""
+        for (col = 0; col < nx; col++) {
+          b = ((col, row) in blocked) && blocked[col, row]
+          line = line (col ? " " : "") (kind == "P1" ? b : (b ? 0 : 255))
+        }
+        print line
+      }
+    }' "$1"
+}
+
+# d2q9-check on files of fewer bytes than threads, and on empty files
+printf '0:\t1.000000000000E-03\n' > "$DIR/line.av_vels.dat"
+printf '0 0 1.0E-03 2.0E-03 3.0E-03 3.3E-02 0\n' > "$DIR/line.final_state.dat"
+printf '0:\t1.0E-03' > "$DIR/short.av_vels.dat"
+printf '0 0 0 0 0 1 1' > "$DIR/short.final_state.dat"
+: > "$DIR/empty.av_vels.dat"
+: > "$DIR/empty.final_state.dat"
+
+expect 0 "one line files" "$DIR/line.av_vels.dat" "$DIR/line.final_state.dat" \
+  "$DIR/line.av_vels.dat" "$DIR/line.final_state.dat"
+expect 0 "files shorter than the thread count, no final newline" "$DIR/short.av_vels.dat" "$DIR/short.final_state.dat" \
+  "$DIR/short.av_vels.dat" "$DIR/short.final_state.dat"
+expect 2 "empty files are an error, not a crash" "$DIR/empty.av_vels.dat" "$DIR/empty.final_state.dat" \
+  "$DIR/empty.av_vels.dat" "$DIR/empty.final_state.dat"
+expect 0 "the 128x128 reference against itself" check/128x128.av_vels.dat check/128x128.final_state.dat \
+  check/128x128.av_vels.dat check/128x128.final_state.dat
+
+# the full 128x128 problem
+if run reference "$TOP/input_128x128.params" "$TOP/obstacles_128x128.dat"; then
+  expect 0 "current matches the 128x128 reference" check/128x128.av_vels.dat check/128x128.final_state.dat \
+    "$DIR/reference/av_vels.dat" "$DIR/reference/final_state.dat"
+fi
+
+# every kernel giving BGK results, on the shortened 128x128 problem
+sed "3s/.*/$ITERS/" input_128x128.params > "$DIR/short.params"
+run current "$DIR/short.params" "$TOP/obstacles_128x128.dat" --kernel=current
+
+for kernel in $("$BGK" --list-kernels | awk '/B\/update/ && !/not BGK/ { print $1 }'); do
+  run "kernel-$kernel" "$DIR/short.params" "$TOP/obstacles_128x128.dat" --kernel="$kernel" &&
+    matches "--kernel=$kernel matches current" current "kernel-$kernel"
+done
+
+# sweep-soa-nt streams only for grids bigger than the last level cache, so force it to
+D2Q9_STREAM_THRESHOLD=0
+export D2Q9_STREAM_THRESHOLD
+run streaming "$DIR/short.params" "$TOP/obstacles_128x128.dat" --kernel=sweep-soa-nt &&
+  matches "--kernel=sweep-soa-nt matches current when it streams" current streaming
+unset D2Q9_STREAM_THRESHOLD
+
+# one geometry in every obstacle file format; cylinders also give sweep-soa-tiled solid and mixed tiles
+nx=128
+ny=128
+
+for format in text rle pbm; do
+  (cd "$DIR" && "$GEN" cylinders --nx=$nx --ny=$ny --iters="$ITERS" --name="$format" --format="$format") > "$DIR/gen.log" 2>&1 ||
+    fail "d2q9-gen --format=$format" "$DIR/gen.log"
+done
+
+pnm "$DIR/obstacles_text.dat" P1 > "$DIR/obstacles_p1.dat"
+pnm "$DIR/obstacles_text.dat" P2 > "$DIR/obstacles_p2.dat"
+
+run format-text "$DIR/input_text.params" "$DIR/obstacles_text.dat"
+
+for format in rle pbm p1 p2; do
+  run "format-$format" "$DIR/input_text.params" "$DIR/obstacles_$format.dat" &&
+    identical "$format obstacles read as the text ones" format-text "format-$format"
+done
+
+run tiled "$DIR/input_text.params" "$DIR/obstacles_text.dat" --kernel=sweep-soa-tiled &&
+  matches "--kernel=sweep-soa-tiled matches current around solid tiles" format-text tiled
+
+# streamed av_vels
+run stream "$DIR/short.params" "$TOP/obstacles_128x128.dat" --kernel=current --stream-av-vels=100 &&
+  identical "--stream-av-vels writes what the buffered run does" current stream
+
+# result cache: a miss, a hit, then a miss for another kernel
+run cache-miss "$DIR/short.params" "$TOP/obstacles_128x128.dat" --kernel=current --result-cache="$DIR/cache" &&
+  run cache-hit "$DIR/short.params" "$TOP/obstacles_128x128.dat" --kernel=current --result-cache="$DIR/cache" &&
+  run cache-other "$DIR/short.params" "$TOP/obstacles_128x128.dat" --kernel=sweep-soa --result-cache="$DIR/cache"
+
+if grep -q "Result cache hit" "$DIR/cache-miss.log" || ! grep -q "Result cache hit" "$DIR/cache-hit.log" ||
+  grep -q "Result cache hit" "$DIR/cache-other.log"; then
+  fail "--result-cache hits only on the repeated run"
+else
+  pass "--result-cache hits only on the repeated run"
+  identical "--result-cache hit copies the stored output" current cache-hit
+fi
+
+# a job through the server
+mkdir -p "$DIR/server"
+(cd "$DIR/server" && exec "$BGK" --serve="$DIR/sock" --kernel=current) > "$DIR/server.log" 2>&1 &
+server=$!
+
+for try in 1 2 3 4 5 6 7 8 9 10; do
+  [ -S "$DIR/sock" ] && break
+  sleep 1
+done
+
+if "$BGK" --submit="$DIR/sock" "$DIR/short.params" "$TOP/obstacles_128x128.dat" "$DIR/submitted" > "$DIR/submit.log" 2>&1; then
+  identical "--submit gets what a plain run writes" current submitted
+else
+  fail "--submit" "$DIR/submit.log"
+fi
+
+"$BGK" --submit="$DIR/sock" quit > /dev/null 2>&1
+wait $server || fail "--serve exits cleanly on quit" "$DIR/server.log"
+
+# libd2q9 through the Python bindings, writing the output files as d2q9-bgk does
+if [ -f "$TOP/libd2q9.so" ] && python3 -c "import numpy" > /dev/null 2>&1; then
+  mkdir -p "$DIR/python"
+
+  if D2Q9_LIB="$TOP/libd2q9.so" python3 - "$TOP/python" "$DIR/short.params" "$TOP/obstacles_128x128.dat" "$DIR/python" \
+    > "$DIR/python.log" 2>&1 << 'EOF'
+import sys
+
+sys.path.insert(0, sys.argv[1])
+import d2q9
+
+with d2q9.Simulation(sys.argv[2], sys.argv[3], kernel="current") as sim:
+    av_vels = sim.step(sim.params.max_iters)
+    state = sim.state()
+    u = state.u
+
+    with open(sys.argv[4] + "/av_vels.dat", "w") as fp:
+        for ii, av_vel in enumerate(av_vels):
+            fp.write("%d:\t%.12E\n" % (ii, av_vel))
+
+    with open(sys.argv[4] + "/final_state.dat", "w") as fp:
+        for jj in range(sim.ny):
+            for ii in range(sim.nx):
+                fp.write("%d %d %.12E %.12E %.12E %.12E %d\n" % (ii, jj, state.u_x[jj, ii], state.u_y[jj, ii],
+                                                                  u[jj, ii], state.pressure[jj, ii],
+                                                                  state.obstacles[jj, ii]))
+EOF
+  then
+    matches "libd2q9 from Python matches d2q9-bgk" current python
+  else
+    fail "libd2q9 from Python" "$DIR/python.log"
+  fi
+else
+  echo "skipped: libd2q9 from Python (needs make lib and numpy)"
+fi
+
+exit $FAILED
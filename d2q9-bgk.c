@@ -49,58 +49,147 @@
 ** if you choose a different obstacle file.
 */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
 #include <math.h>
 #include <time.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
 #include <omp.h>
+#include <immintrin.h> /* _mm_malloc() and _mm_free() */
+
+#include "d2q9-bgk.h"
+
+#define RLE_MAGIC "D2Q9RLE1" /* 8 byte header of the run-length obstacle format */
+#define AV_STREAM_CHUNK 1024 /* default no. of av_vels buffered per streamed write */
+#define TUNE_CACHE "d2q9-tune.cache" /* default autotuner cache file */
+#define CONVERGE_TOL 1e-9f      /* default --converge tolerance */
+#define CONVERGE_WINDOW 1000     /* default --converge-window */
+#define CONVERGE_SAMPLES 4096    /* velocity field samples with the default stride */
+
+/* where allocate_grids() puts things in the lattice arena */
+#define GRID_CELLS ARENA_HEADER                /* the cells t_speed */
+#define GRID_TMP_CELLS (ARENA_HEADER + 128)    /* the tmp_cells t_speed */
+#define GRID_OBSTACLES (ARENA_HEADER + 256)    /* the obstacle map */
 
-#define NSPEEDS 9
-#define FINALSTATEFILE "final_state.dat"
-#define AVVELSFILE "av_vels.dat"
+t_trace trace;
 
-/* struct to hold the parameter values */
+#define TRACE_STRIDE 8 /* doubles per cache line */
+
+/* hardware counters read around the time loop with --perf-counters */
+enum
+{
+  COUNTER_CYCLES,
+  COUNTER_INSTRUCTIONS,
+  COUNTER_LLC_MISSES,
+  COUNTER_DTLB_MISSES,
+  COUNTER_FP_SCALAR, /* FP_ARITH_INST_RETIRED.SCALAR_SINGLE, Intel only */
+  COUNTER_FP_128,    /* FP_ARITH_INST_RETIRED.128B_PACKED_SINGLE */
+  COUNTER_FP_256,    /* FP_ARITH_INST_RETIRED.256B_PACKED_SINGLE */
+  COUNTER_FP_512,    /* FP_ARITH_INST_RETIRED.512B_PACKED_SINGLE */
+  NCOUNTERS
+};
+
+/* struct to hold one perf_event fd per counter per OpenMP thread */
+typedef struct
+{
+  int nthreads;
+  int *fds;                 /* [thread * NCOUNTERS + counter], -1 if unavailable */
+  double totals[NCOUNTERS]; /* summed over threads, scaled for multiplexing */
+  int available[NCOUNTERS]; /* no. of threads the counter could be opened on */
+  int error[NCOUNTERS];     /* errno of the first failed open */
+} t_counters;
+
+/* struct to hold the state of the av_vels writer thread */
 typedef struct
 {
-  int nx;           /* no. of cells in x-direction */
-  int ny;           /* no. of cells in y-direction */
-  int maxIters;     /* no. of iterations */
-  int reynolds_dim; /* dimension for Reynolds number */
-  float density;    /* density per link */
-  float accel;      /* density redistribution */
-  float omega;      /* relaxation parameter */
-} t_param;
+  FILE *fp;              /* av_vels output file */
+  float *front;          /* chunk being filled by the time loop */
+  float *back;           /* chunk being written out by the writer thread */
+  int chunk;             /* no. of values per chunk */
+  int fill;              /* no. of values in the front chunk */
+  int base;              /* timestep of the first value in the front chunk */
+  int pending;           /* no. of values in the back chunk still to be written */
+  int pending_base;      /* timestep of the first value in the back chunk */
+  int done;              /* set once the last chunk has been handed over */
+  pthread_t writer;      /* writer thread */
+  pthread_mutex_t lock;  /* protects the back chunk hand over */
+  pthread_cond_t cond;   /* signalled on every hand over and completion */
+} t_av_stream;
+
+#ifdef PROFILE_PHASES
+/*
+** Per-thread phase timings, compiled in with -DPROFILE_PHASES.
+** Each sample goes into running min/max/sum and a log2 histogram
+** (PROFILE_BINS_PER_OCTAVE bins per doubling of nanoseconds) from
+** which the p99 is read, so memory use does not grow with maxIters.
+*/
+#define PROFILE_BINS 256
+#define PROFILE_BINS_PER_OCTAVE 8
 
-/* struct to hold the 'speed' values */
+/* struct to hold the statistics of one phase on one thread */
+typedef struct
+{
+  double min;
+  double max;
+  double sum;
+  long count;
+  long hist[PROFILE_BINS];
+} t_phase_stats;
+
+/* struct to hold the phase statistics of all threads */
 typedef struct
 {
-  float *speeds0;
-  float *speeds1;
-  float *speeds2;
-  float *speeds3;
-  float *speeds4;
-  float *speeds5;
-  float *speeds6;
-  float *speeds7;
-  float *speeds8;
-} t_speed;
-
-const float c_sq = 1.f / 3.f; /* square of speed of sound */
-const float c_sq_inv = 3.f;   /* square of speed of sound */
-const float w0 = 4.f / 9.f;   /* weighting factor */
-const float w1 = 1.f / 9.f;   /* weighting factor */
-const float w2 = 1.f / 36.f;  /* weighting factor */
+  int nthreads;
+  t_phase_stats *stats; /* [thread * NPHASES + phase] */
+  double *reduce_end;   /* per thread time the reduction finished, padded to a cache line */
+} t_profile;
+
+t_profile profile;
+
+#define PROFILE_STRIDE 8 /* doubles per cache line */
+#endif
 
 /*
 ** function prototypes
 */
 
-/* load params, allocate memory, load obstacles & initialise fluid particle densities */
-int initialise(const char *paramfile, const char *obstaclefile,
-               t_param *params, t_speed **cells_ptr, t_speed **tmp_cells_ptr,
-               int **obstacles_ptr, float **av_vels_ptr);
+/* parse the optional flags following the input files */
+void parse_options(int argc, char *argv[], t_options *options);
+
+/* use a tuned configuration, except where OMP_NUM_THREADS, OMP_SCHEDULE or --kernel already chose */
+void apply_tune(const t_tune *tune, t_options *options);
+
+/*
+** Streamed av_vels output. Values are buffered in fixed size chunks
+** which a writer thread appends to AVVELSFILE (and flushes) while the
+** time loop carries on, so memory use does not depend on maxIters.
+*/
+void av_stream_open(t_av_stream *stream, int chunk);
+void av_stream_push(t_av_stream *stream, float av_vel);
+void av_stream_close(t_av_stream *stream);
+
+/*
+** Obstacle loading. load_obstacles() picks the format from the first bytes of the file:
+**  - "D2Q9RLE1": binary run-length encoding (see load_obstacles_rle())
+**  - "P1"/"P4": PBM bitmap, set (black) pixels are blocked
+**  - "P2"/"P5": PGM greymap, pixels darker than half of maxval are blocked
+**  - anything else: the original "x y 1" text triplets
+** Images are stored top row first, so image row 0 is cell row ny - 1.
+*/
+int load_obstacles_text(FILE *fp, const t_param *params, int *obstacles);
+int load_obstacles_rle(FILE *fp, const t_param *params, int *obstacles);
+int load_obstacles_pnm(FILE *fp, const t_param *params, int *obstacles);
 
 /*
 ** The main calculation methods.
@@ -112,11 +201,6 @@ float timestep(const t_param params,
                float *restrict cells_speeds0, float *restrict cells_speeds1, float *restrict cells_speeds2, float *restrict cells_speeds3, float *restrict cells_speeds4, float *restrict cells_speeds5, float *restrict cells_speeds6, float *restrict cells_speeds7, float *restrict cells_speeds8, float *restrict tmp_cells_speeds0, float *restrict tmp_cells_speeds1, float *restrict tmp_cells_speeds2, float *restrict tmp_cells_speeds3, float *restrict tmp_cells_speeds4, float *restrict tmp_cells_speeds5, float *restrict tmp_cells_speeds6, float *restrict tmp_cells_speeds7, float *restrict tmp_cells_speeds8,
                int *restrict obstacles);
 static inline int accelerate_flow(const t_param params, t_speed *restrict cells, int *obstacles);
-int write_values(const t_param params, t_speed *cells, int *obstacles, float *av_vels);
-
-/* finalise, including freeing up allocated memory */
-int finalise(const t_param *params, t_speed **cells_ptr, t_speed **tmp_cells_ptr,
-             int **obstacles_ptr, float **av_vels_ptr);
 
 /* Sum all the densities in the grid.
 ** The total should remain constant from one timestep to the next. */
@@ -125,13 +209,52 @@ float total_density(const t_param params, t_speed *cells);
 /* compute average velocity */
 float av_velocity(const t_param params, t_speed *cells, int *obstacles);
 
-/* calculate Reynolds number */
-float calc_reynolds(const t_param params, t_speed *cells, int *obstacles);
+#ifdef PROFILE_PHASES
+/* phase timing collection and min/mean/max/p99 and load imbalance report */
+void profile_init(int nthreads);
+void profile_report(void);
+void profile_free(void);
+#endif
+
+/*
+** Hardware counters. Each OpenMP thread opens its own events (the
+** thread pool already exists by the time loop, so inherited counters
+** would miss it); the master then enables, disables and reads them all.
+** Counters that cannot be opened are reported as unavailable.
+*/
+void counters_open(t_counters *counters);
+void counters_start(t_counters *counters);
+void counters_stop(t_counters *counters);
+void counters_report(const t_counters *counters, double updates);
+void counters_close(t_counters *counters);
+
+/*
+** Chrome trace-event export (load in chrome://tracing or ui.perfetto.dev).
+** One step in every trace_every is traced: the span of each thread's
+** share of the sweep and its wait at the barrier ending the step,
+** accelerate_flow(), the av_vels writer's file output, and the final
+** write_values(). Events are kept per thread in memory and written
+** out by trace_write() at the end of the run.
+*/
+void trace_init(int every);
+static inline void trace_begin_step(int step)
+{
+  trace.step = step;
+  trace.active = trace.enabled && (step % trace.every == 0);
+}
+void trace_write(const char *filename);
+void trace_free(void);
+
+/* print lattice update rates and achieved memory bandwidth, plus a one line JSON summary */
+void report_performance(const t_param params, const t_kernel *kernel, int *obstacles, int iters, float reynolds,
+                        double init_time, double comp_time, double col_time, double tot_time);
 
 /* utility functions */
-void die(const char *message, const int line, const char *file);
 void usage(const char *exe);
+void list_kernels(void);
 
+/* main() and its option handling belong to the driver, and are left out of libd2q9 (-DD2Q9_LIBRARY) */
+#ifndef D2Q9_LIBRARY
 /*
 ** main program:
 ** initialise, timestep loop, finalise
@@ -141,15 +264,42 @@ int main(int argc, char *argv[])
   char *paramfile = NULL;                                                            /* name of the input parameter file */
   char *obstaclefile = NULL;                                                         /* name of a the input obstacle file */
   t_param params;                                                                    /* struct to hold parameter values */
+  t_options options;                                                                 /* struct to hold command line options */
+  t_av_stream av_stream;                                                             /* av_vels writer, if streaming */
+  t_counters counters;                                                               /* hardware counters, if requested */
+  t_converge converge;                                                               /* steady-state monitor, if requested */
   t_speed *cells = NULL;                                                             /* grid containing fluid densities */
   t_speed *tmp_cells = NULL;                                                         /* scratch space */
+  void *grid = NULL;                                                                 /* cells in the layout of the kernel */
+  void *tmp_grid = NULL;                                                             /* tmp_cells in the layout of the kernel */
   int *obstacles = NULL;                                                             /* grid indicating which cells are blocked */
   float *av_vels = NULL;                                                             /* a record of the av. velocity computed for each timestep */
   struct timeval timstr;                                                             /* structure to hold elapsed time */
   double tot_tic, tot_toc, init_tic, init_toc, comp_tic, comp_toc, col_tic, col_toc; /* floating point numbers to calculate elapsed wallclock time */
 
+  /* static row partition, unless OMP_SCHEDULE or the autotuner say otherwise */
+  if (getenv("OMP_SCHEDULE") == NULL)
+    omp_set_schedule(omp_sched_static, 0);
+
   /* parse the command line */
-  if (argc != 3)
+  if (argc == 2 && strcmp(argv[1], "--list-kernels") == 0)
+  {
+    list_kernels();
+    return EXIT_SUCCESS;
+  }
+  else if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+  {
+    return bench(argc, argv);
+  }
+  else if (argc >= 2 && strncmp(argv[1], "--serve=", 8) == 0)
+  {
+    return serve(argc, argv);
+  }
+  else if (argc >= 2 && strncmp(argv[1], "--submit=", 9) == 0)
+  {
+    return submit(argc, argv);
+  }
+  else if (argc < 3)
   {
     usage(argv[0]);
   }
@@ -157,61 +307,152 @@ int main(int argc, char *argv[])
   {
     paramfile = argv[1];
     obstaclefile = argv[2];
+    parse_options(argc, argv, &options);
   }
 
   /* Total/init time starts here: initialise our data structures and load values from file */
   gettimeofday(&timstr, NULL);
   tot_tic = timstr.tv_sec + (timstr.tv_usec / 1000000.0);
   init_tic = tot_tic;
-  initialise(paramfile, obstaclefile, &params, &cells, &tmp_cells, &obstacles, &av_vels);
+
+  /* pin the threads before initialise() first touches the grids with the sweep's row partition */
+  if (!options.no_pin)
+    numa_pin_threads();
+
+  int init_threads = omp_get_max_threads();
+  omp_sched_t init_schedule;
+  int init_chunk;
+  omp_get_schedule(&init_schedule, &init_chunk);
+  initialise(paramfile, obstaclefile, &options, &params, &cells, &tmp_cells, &obstacles, &av_vels);
+
+  /* find, or look up, the fastest configuration for this problem on this CPU */
+  t_tune tune;
+
+  if (options.autotune)
+  {
+    autotune(paramfile, obstaclefile, options.tune_cache, &tune);
+    apply_tune(&tune, &options);
+  }
+  else if (tune_lookup(options.tune_cache, params, obstacles, &tune))
+    apply_tune(&tune, &options);
+
+  /* a tuned thread count or schedule partitions the rows differently: lay the grids out again for it */
+  omp_sched_t schedule;
+  int chunk;
+  omp_get_schedule(&schedule, &chunk);
+
+  if (omp_get_max_threads() != init_threads || schedule != init_schedule || chunk != init_chunk)
+  {
+    finalise(&params, &cells, &tmp_cells, &obstacles, &av_vels);
+
+    if (!options.no_pin)
+      numa_pin_threads();
+
+    initialise(paramfile, obstaclefile, &options, &params, &cells, &tmp_cells, &obstacles, &av_vels);
+  }
+
+  if (options.kernel == NULL)
+    options.kernel = &kernels[nkernels - 1];
+
+  /* the warm start specialises its own, for the coarse grid */
+  options.asked = options.kernel;
+  options.kernel = kernel_for_grid(options.kernel, params);
+
+  /* a repeat of a cached run: copy its output into place */
+  char result[17];
+
+  if (options.result_cache)
+  {
+    result_key(params, obstacles, &options, result);
+
+    if (result_fetch(options.result_cache, result))
+    {
+      printf("Result cache hit:\t\t\t%s/%s, %s and %s copied\n", options.result_cache, result,
+             FINALSTATEFILE, AVVELSFILE);
+      finalise(&params, &cells, &tmp_cells, &obstacles, &av_vels);
+      return EXIT_SUCCESS;
+    }
+  }
+
+  if (options.warm_start)
+    warm_start(params, obstacles, &options, cells);
+
+  if (options.stream_av_vels)
+    av_stream_open(&av_stream, options.stream_av_vels);
+
+  if (options.converge_tol > 0.f)
+    converge_init(&converge, params, &options);
+
+  kernel_grids_open(options.kernel, params, cells, tmp_cells, obstacles, &grid, &tmp_grid);
+
+#ifdef PROFILE_PHASES
+  profile_init(omp_get_max_threads());
+#endif
+
+  if (options.trace_file)
+    trace_init(options.trace_every);
+
+#ifdef PROFILE_PHASES
+  if (!options.kernel->parallel)
+#else
+  if (options.trace_file && !options.kernel->parallel)
+#endif
+    fprintf(stderr, "warning: kernel %s is a serial ported variant and records no phase timings or trace spans\n",
+            options.kernel->name);
+
+  if (options.perf_counters)
+  {
+    counters_open(&counters);
+    counters_start(&counters);
+  }
 
   /* Init time stops here, compute time starts*/
   gettimeofday(&timstr, NULL);
   init_toc = timstr.tv_sec + (timstr.tv_usec / 1000000.0);
   comp_tic = init_toc;
 
+  int iters = params.maxIters; /* no. of steps actually run */
+
   for (int tt = 0; tt < params.maxIters; tt++)
   {
-    accelerate_flow(params, cells, obstacles);
-    av_vels[tt] = timestep(params,
-                           cells->speeds0,
-                           cells->speeds1,
-                           cells->speeds2,
-                           cells->speeds3,
-                           cells->speeds4,
-                           cells->speeds5,
-                           cells->speeds6,
-                           cells->speeds7,
-                           cells->speeds8,
-                           tmp_cells->speeds0,
-                           tmp_cells->speeds1,
-                           tmp_cells->speeds2,
-                           tmp_cells->speeds3,
-                           tmp_cells->speeds4,
-                           tmp_cells->speeds5,
-                           tmp_cells->speeds6,
-                           tmp_cells->speeds7,
-                           tmp_cells->speeds8,
-                           obstacles);
-
-    t_speed *tmp = cells;
-    cells = tmp_cells;
-    tmp_cells = tmp;
-
-    // av_vels[tt] = av_velocity(params, cells, obstacles);
+    trace_begin_step(tt);
+    const float av_vel = options.kernel->step(params, &grid, &tmp_grid, obstacles);
+
+    if (options.stream_av_vels)
+      av_stream_push(&av_stream, av_vel);
+    else
+      av_vels[tt] = av_vel;
+
+    if (options.converge_tol > 0.f &&
+        converge_check(&converge, params, options.kernel, grid, obstacles, tt, av_vel))
+    {
+      iters = tt + 1;
+      break;
+    }
+
 #ifdef DEBUG
     printf("==timestep: %d==\n", tt);
-    printf("av velocity: %.12E\n", av_vels[tt]);
-    printf("tot density: %.12E\n", total_density(params, cells));
+    printf("av velocity: %.12E\n", av_vel);
+    if (options.kernel->layout == LAYOUT_SOA)
+      printf("tot density: %.12E\n", total_density(params, grid));
 #endif
   }
 
+  if (options.perf_counters)
+    counters_stop(&counters);
+
+  trace_begin_step(-1);
+
+  kernel_grids_close(options.kernel, params, &cells, &tmp_cells, grid, tmp_grid);
+
   /* Compute time stops here, collate time starts*/
   gettimeofday(&timstr, NULL);
   comp_toc = timstr.tv_sec + (timstr.tv_usec / 1000000.0);
   col_tic = comp_toc;
 
   // Collate data from ranks here
+  if (options.stream_av_vels)
+    av_stream_close(&av_stream);
 
   /* Total/collate time stops here.*/
   gettimeofday(&timstr, NULL);
@@ -219,17 +460,92 @@ int main(int argc, char *argv[])
   tot_toc = col_toc;
 
   /* write final values and free memory */
+  const float reynolds = calc_reynolds(params, cells, obstacles);
   printf("==done==\n");
-  printf("Reynolds number:\t\t%.12E\n", calc_reynolds(params, cells, obstacles));
+  printf("Reynolds number:\t\t%.12E\n", reynolds);
   printf("Elapsed Init time:\t\t\t%.6lf (s)\n", init_toc - init_tic);
   printf("Elapsed Compute time:\t\t\t%.6lf (s)\n", comp_toc - comp_tic);
   printf("Elapsed Collate time:\t\t\t%.6lf (s)\n", col_toc - col_tic);
   printf("Elapsed Total time:\t\t\t%.6lf (s)\n", tot_toc - tot_tic);
-  write_values(params, cells, obstacles, av_vels);
+  if (options.converge_tol > 0.f)
+  {
+    if (iters < params.maxIters)
+      printf("Converged after:\t\t\t%d of %d steps\n", iters, params.maxIters);
+    else
+      printf("Not converged after:\t\t\t%d steps\n", iters);
+    printf("Change per step:\t\t\tav_vels %.3E, velocity field %.3E (tolerance %.3E)\n",
+           converge.av_change, converge.field_change, converge.tol);
+    converge_free(&converge);
+  }
+  report_performance(params, options.kernel, obstacles, iters, reynolds,
+                     init_toc - init_tic, comp_toc - comp_tic, col_toc - col_tic, tot_toc - tot_tic);
+  if (options.kernel->layout == LAYOUT_SOA)
+    numa_report(params, cells, tmp_cells, obstacles);
+  if (options.perf_counters)
+  {
+    counters_report(&counters, (double)params.nx * params.ny * iters);
+    counters_close(&counters);
+  }
+#ifdef PROFILE_PHASES
+  profile_report();
+  profile_free();
+#endif
+  const double write_tic = monotonic_clock();
+  write_values(params, cells, obstacles, av_vels, iters);
+
+  if (options.trace_file)
+  {
+    trace_span(TRACE_MAIN, "write_values", write_tic, monotonic_clock());
+    trace_write(options.trace_file);
+    trace_free();
+  }
+
+  if (options.result_cache)
+    result_store(options.result_cache, result, params, &options);
+
   finalise(&params, &cells, &tmp_cells, &obstacles, &av_vels);
 
   return EXIT_SUCCESS;
 }
+#endif
+
+float current_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles)
+{
+  t_speed *cells = *cells_ptr;
+  t_speed *tmp_cells = *tmp_cells_ptr;
+
+  PROFILE_TIC(accel_tic);
+  const double trace_tic = trace.active ? monotonic_clock() : 0.0;
+  accelerate_flow(params, cells, obstacles);
+  if (trace.active)
+    trace_span(TRACE_MAIN, "accelerate_flow", trace_tic, monotonic_clock());
+  PROFILE_RECORD(0, PHASE_ACCELERATE, accel_tic);
+  const float av_vel = timestep(params,
+                                cells->speeds0,
+                                cells->speeds1,
+                                cells->speeds2,
+                                cells->speeds3,
+                                cells->speeds4,
+                                cells->speeds5,
+                                cells->speeds6,
+                                cells->speeds7,
+                                cells->speeds8,
+                                tmp_cells->speeds0,
+                                tmp_cells->speeds1,
+                                tmp_cells->speeds2,
+                                tmp_cells->speeds3,
+                                tmp_cells->speeds4,
+                                tmp_cells->speeds5,
+                                tmp_cells->speeds6,
+                                tmp_cells->speeds7,
+                                tmp_cells->speeds8,
+                                obstacles);
+
+  *cells_ptr = tmp_cells;
+  *tmp_cells_ptr = cells;
+
+  return av_vel;
+}
 
 float timestep(const t_param params,
                float *restrict cells_speeds0, float *restrict cells_speeds1, float *restrict cells_speeds2, float *restrict cells_speeds3, float *restrict cells_speeds4, float *restrict cells_speeds5, float *restrict cells_speeds6, float *restrict cells_speeds7, float *restrict cells_speeds8, float *restrict tmp_cells_speeds0, float *restrict tmp_cells_speeds1, float *restrict tmp_cells_speeds2, float *restrict tmp_cells_speeds3, float *restrict tmp_cells_speeds4, float *restrict tmp_cells_speeds5, float *restrict tmp_cells_speeds6, float *restrict tmp_cells_speeds7, float *restrict tmp_cells_speeds8,
@@ -268,8 +584,15 @@ float timestep(const t_param params,
 
 // tried collapse(2) but made vectorisation worse?
 // Tried just parallel for on outer loop which was fast for small images but scaled horribly - taking 0.9s on 128 but 67s on 1024
-#pragma omp parallel for reduction(+ \
-                                   : tot_u, tot_cells) firstprivate(params, tmp_cells_speeds0, tmp_cells_speeds1, tmp_cells_speeds2, tmp_cells_speeds3, tmp_cells_speeds4, tmp_cells_speeds5, tmp_cells_speeds6, tmp_cells_speeds7, tmp_cells_speeds8, cells_speeds0, cells_speeds1, cells_speeds2, cells_speeds3, cells_speeds4, cells_speeds5, cells_speeds6, cells_speeds7, cells_speeds8)
+// The av_vels reduction is done by hand so the sweep, the reduction and the wait at the end can be timed separately
+#pragma omp parallel firstprivate(params, tmp_cells_speeds0, tmp_cells_speeds1, tmp_cells_speeds2, tmp_cells_speeds3, tmp_cells_speeds4, tmp_cells_speeds5, tmp_cells_speeds6, tmp_cells_speeds7, tmp_cells_speeds8, cells_speeds0, cells_speeds1, cells_speeds2, cells_speeds3, cells_speeds4, cells_speeds5, cells_speeds6, cells_speeds7, cells_speeds8)
+  {
+    float thread_u = 0.0f;
+    int thread_cells = 0;
+    PROFILE_TIC(sweep_tic);
+    const double trace_tic = trace.active ? monotonic_clock() : 0.0;
+
+#pragma omp for schedule(runtime) nowait
   for (int jj = 0; jj < params.ny; jj++)
   {
     // __assume(jj != 0);
@@ -277,7 +600,7 @@ float timestep(const t_param params,
     // __assume(jj != params.ny - 1);
     int y_n = (jj == params.ny - 1) ? 0 : (jj + 1);
 #pragma omp simd reduction(+ \
-                           : tot_u, tot_cells) aligned(cells_speeds0 : 64, cells_speeds1 : 64, cells_speeds2 : 64, cells_speeds3 : 64, cells_speeds4 : 64, cells_speeds5 : 64, cells_speeds6 : 64, cells_speeds7 : 64, cells_speeds8 : 64, tmp_cells_speeds0 : 64, tmp_cells_speeds1 : 64, tmp_cells_speeds2 : 64, tmp_cells_speeds3 : 64, tmp_cells_speeds4 : 64, tmp_cells_speeds5 : 64, tmp_cells_speeds6 : 64, tmp_cells_speeds7 : 64, tmp_cells_speeds8 : 64)
+                           : thread_u, thread_cells) aligned(cells_speeds0 : 64, cells_speeds1 : 64, cells_speeds2 : 64, cells_speeds3 : 64, cells_speeds4 : 64, cells_speeds5 : 64, cells_speeds6 : 64, cells_speeds7 : 64, cells_speeds8 : 64, tmp_cells_speeds0 : 64, tmp_cells_speeds1 : 64, tmp_cells_speeds2 : 64, tmp_cells_speeds3 : 64, tmp_cells_speeds4 : 64, tmp_cells_speeds5 : 64, tmp_cells_speeds6 : 64, tmp_cells_speeds7 : 64, tmp_cells_speeds8 : 64)
     for (int ii = 0; ii < params.nx; ii++)
     {
       // __assume(jj != 0);
@@ -350,16 +673,86 @@ float timestep(const t_param params,
         tmp_cells_speeds8[ii + jj * params.nx] = s8 + params.omega * (d_equ8 - s8);
 
         /* accumulate the norm of x- and y- velocity components */
-        tot_u += sqrtf((u_x * u_x) + (u_y * u_y));
+        thread_u += sqrtf((u_x * u_x) + (u_y * u_y));
         /* increase counter of inspected cells */
-        tot_cells += 1;
+        thread_cells += 1;
       }
     }
   }
 
+    PROFILE_RECORD(omp_get_thread_num(), PHASE_SWEEP, sweep_tic);
+    PROFILE_TIC(reduce_tic);
+
+    if (trace.active)
+    {
+      const double trace_toc = monotonic_clock();
+      trace_span(omp_get_thread_num(), "sweep", trace_tic, trace_toc);
+      trace.sweep_end[omp_get_thread_num() * TRACE_STRIDE] = trace_toc;
+    }
+
+#pragma omp atomic
+    tot_u += thread_u;
+#pragma omp atomic
+    tot_cells += thread_cells;
+
+#ifdef PROFILE_PHASES
+    PROFILE_RECORD(omp_get_thread_num(), PHASE_REDUCE, reduce_tic);
+    profile.reduce_end[omp_get_thread_num() * PROFILE_STRIDE] = monotonic_clock();
+#endif
+  }
+
+  phase_region_done();
+
   return tot_u / (float)tot_cells;
 }
 
+void phase_sweep_done(double trace_tic)
+{
+  const int thread = omp_get_thread_num();
+
+  if (trace.active)
+  {
+    const double trace_toc = monotonic_clock();
+    trace_span(thread, "sweep", trace_tic, trace_toc);
+    trace.sweep_end[thread * TRACE_STRIDE] = trace_toc;
+  }
+
+#ifdef PROFILE_PHASES
+  /* the reduction clause adds the partials at the barrier, so the wait starts here */
+  profile.reduce_end[thread * PROFILE_STRIDE] = monotonic_clock();
+#endif
+}
+
+void phase_region_done(void)
+{
+#ifdef PROFILE_PHASES
+  /* the implicit barrier at the end of the parallel region */
+  const double region_end = monotonic_clock();
+
+  for (int tt = 0; tt < profile.nthreads; tt++)
+  {
+    if (profile.reduce_end[tt * PROFILE_STRIDE] > 0.0)
+      profile_record(tt, PHASE_BARRIER, region_end - profile.reduce_end[tt * PROFILE_STRIDE]);
+
+    profile.reduce_end[tt * PROFILE_STRIDE] = 0.0;
+  }
+#endif
+
+  if (trace.active)
+  {
+    /* the wait covers this thread's reduction and the implicit barrier ending the region */
+    const double region_end = monotonic_clock();
+
+    for (int tt = 0; tt < trace.nthreads; tt++)
+    {
+      if (trace.sweep_end[tt * TRACE_STRIDE] > 0.0)
+        trace_span(tt, "barrier wait", trace.sweep_end[tt * TRACE_STRIDE], region_end);
+
+      trace.sweep_end[tt * TRACE_STRIDE] = 0.0;
+    }
+  }
+}
+
 static inline int accelerate_flow(const t_param params, t_speed *restrict cells, int *obstacles)
 {
   /* compute weighting factors */
@@ -437,14 +830,33 @@ float av_velocity(const t_param params, t_speed *cells, int *obstacles)
   return tot_u / (float)tot_cells;
 }
 
-int initialise(const char *paramfile, const char *obstaclefile,
+int initialise(const char *paramfile, const char *obstaclefile, const t_options *options,
                t_param *params, t_speed **cells_ptr, t_speed **tmp_cells_ptr,
                int **obstacles_ptr, float **av_vels_ptr)
+{
+  read_params(paramfile, params);
+
+  allocate_grids(params, cells_ptr, tmp_cells_ptr, obstacles_ptr);
+
+  /* read-in the blocked cells */
+  load_obstacles(obstaclefile, params, *obstacles_ptr);
+
+  /*
+  ** allocate space to hold a record of the avarage velocities computed
+  ** at each timestep, unless they are streamed out as we go
+  */
+  if (options->stream_av_vels)
+    *av_vels_ptr = NULL;
+  else
+    *av_vels_ptr = (float *)malloc(sizeof(float) * params->maxIters);
+
+  return EXIT_SUCCESS;
+}
+
+int read_params(const char *paramfile, t_param *params)
 {
   char message[1024]; /* message buffer */
   FILE *fp;           /* file pointer */
-  int xx, yy;         /* generic array indices */
-  int blocked;        /* indicates whether a cell is blocked by an obstacle */
   int retval;         /* to hold return value for checking */
 
   /* open the parameter file */
@@ -495,6 +907,11 @@ int initialise(const char *paramfile, const char *obstaclefile,
   /* and close up the file */
   fclose(fp);
 
+  return EXIT_SUCCESS;
+}
+
+void allocate_grids(const t_param *params, t_speed **cells_ptr, t_speed **tmp_cells_ptr, int **obstacles_ptr)
+{
   /*
   ** Allocate memory.
   **
@@ -514,51 +931,58 @@ int initialise(const char *paramfile, const char *obstaclefile,
   ** a 1D array of these structs.
   */
 
-  /* main grid */
-  *cells_ptr = (t_speed *)_mm_malloc(sizeof(t_speed), 64);
+  /*
+  ** Everything lives in one arena (arena.c): the two t_speed structs and
+  ** the obstacles, then the 18 speed arrays, with staggered bases so the
+  ** 18 streams of a sweep fall in different L1 and L2 sets rather than
+  ** all aliasing when nx * ny is a power of two.
+  */
+  float *arrays[2 * NSPEEDS];
+  char *arena = arena_create_arrays(GRID_OBSTACLES + sizeof(int) * params->nx * params->ny +
+                                        TILE_MAP_BYTES(params->nx * params->ny),
+                                    sizeof(float) * params->nx * params->ny, 2 * NSPEEDS, arrays);
 
-  if (*cells_ptr == NULL)
-    die("cannot allocate memory for cells", __LINE__, __FILE__);
+  /* main grid */
+  *cells_ptr = (t_speed *)(arena + GRID_CELLS);
 
   /* 'helper' grid, used as scratch space */
-  *tmp_cells_ptr = (t_speed *)_mm_malloc(sizeof(t_speed), 64);
-
-  if (*tmp_cells_ptr == NULL)
-    die("cannot allocate memory for tmp_cells", __LINE__, __FILE__);
+  *tmp_cells_ptr = (t_speed *)(arena + GRID_TMP_CELLS);
 
   /* the map of obstacles */
-  *obstacles_ptr = _mm_malloc(sizeof(int) * (params->ny * params->nx), 64);
-
-  if (*obstacles_ptr == NULL)
-    die("cannot allocate column memory for obstacles", __LINE__, __FILE__);
-
-  // Allocate SoA`
-  (*tmp_cells_ptr)->speeds0 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*tmp_cells_ptr)->speeds1 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*tmp_cells_ptr)->speeds2 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*tmp_cells_ptr)->speeds3 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*tmp_cells_ptr)->speeds4 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*tmp_cells_ptr)->speeds5 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*tmp_cells_ptr)->speeds6 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*tmp_cells_ptr)->speeds7 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*tmp_cells_ptr)->speeds8 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-
-  (*cells_ptr)->speeds0 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*cells_ptr)->speeds1 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*cells_ptr)->speeds2 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*cells_ptr)->speeds3 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*cells_ptr)->speeds4 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*cells_ptr)->speeds5 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*cells_ptr)->speeds6 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*cells_ptr)->speeds7 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
-  (*cells_ptr)->speeds8 = (float *)_mm_malloc(sizeof(float) * (params->ny * params->nx), 64);
+  *obstacles_ptr = (int *)(arena + GRID_OBSTACLES);
+
+  (*cells_ptr)->speeds0 = arrays[0];
+  (*cells_ptr)->speeds1 = arrays[1];
+  (*cells_ptr)->speeds2 = arrays[2];
+  (*cells_ptr)->speeds3 = arrays[3];
+  (*cells_ptr)->speeds4 = arrays[4];
+  (*cells_ptr)->speeds5 = arrays[5];
+  (*cells_ptr)->speeds6 = arrays[6];
+  (*cells_ptr)->speeds7 = arrays[7];
+  (*cells_ptr)->speeds8 = arrays[8];
+
+  (*tmp_cells_ptr)->speeds0 = arrays[9];
+  (*tmp_cells_ptr)->speeds1 = arrays[10];
+  (*tmp_cells_ptr)->speeds2 = arrays[11];
+  (*tmp_cells_ptr)->speeds3 = arrays[12];
+  (*tmp_cells_ptr)->speeds4 = arrays[13];
+  (*tmp_cells_ptr)->speeds5 = arrays[14];
+  (*tmp_cells_ptr)->speeds6 = arrays[15];
+  (*tmp_cells_ptr)->speeds7 = arrays[16];
+  (*tmp_cells_ptr)->speeds8 = arrays[17];
+
+  reset_grids(params, *cells_ptr, *tmp_cells_ptr, *obstacles_ptr);
+}
 
+void reset_grids(const t_param *params, t_speed *cells, t_speed *tmp_cells, int *obstacles)
+{
   /* initialise densities */
   const float w0 = params->density * 4.f / 9.f;
   const float w1 = params->density / 9.f;
   const float w2 = params->density / 36.f;
 
-#pragma omp parallel for firstprivate(params)
+  /* the sweep's schedule, so each row is first touched by the thread (and on the node) that will sweep it */
+#pragma omp parallel for firstprivate(params) schedule(runtime)
   for (int jj = 0; jj < params->ny; jj++)
   {
 #pragma omp simd
@@ -566,32 +990,39 @@ int initialise(const char *paramfile, const char *obstaclefile,
     {
       /* centre */
 
-      (*cells_ptr)->speeds0[ii + jj * params->nx] = w0;
-      (*cells_ptr)->speeds1[ii + jj * params->nx] = w1;
-      (*cells_ptr)->speeds2[ii + jj * params->nx] = w1;
-      (*cells_ptr)->speeds3[ii + jj * params->nx] = w1;
-      (*cells_ptr)->speeds4[ii + jj * params->nx] = w1;
-      (*cells_ptr)->speeds5[ii + jj * params->nx] = w2;
-      (*cells_ptr)->speeds6[ii + jj * params->nx] = w2;
-      (*cells_ptr)->speeds7[ii + jj * params->nx] = w2;
-      (*cells_ptr)->speeds8[ii + jj * params->nx] = w2;
-      (*obstacles_ptr)[ii + jj * params->nx] = 0;
-
-      // Try "first touch" on tmp cells too?
-      (*tmp_cells_ptr)->speeds0[ii + jj * params->nx] = 0;
-      (*tmp_cells_ptr)->speeds1[ii + jj * params->nx] = 0;
-      (*tmp_cells_ptr)->speeds2[ii + jj * params->nx] = 0;
-      (*tmp_cells_ptr)->speeds3[ii + jj * params->nx] = 0;
-      (*tmp_cells_ptr)->speeds4[ii + jj * params->nx] = 0;
-      (*tmp_cells_ptr)->speeds5[ii + jj * params->nx] = 0;
-      (*tmp_cells_ptr)->speeds6[ii + jj * params->nx] = 0;
-      (*tmp_cells_ptr)->speeds7[ii + jj * params->nx] = 0;
-      (*tmp_cells_ptr)->speeds8[ii + jj * params->nx] = 0;
+      cells->speeds0[ii + jj * params->nx] = w0;
+      cells->speeds1[ii + jj * params->nx] = w1;
+      cells->speeds2[ii + jj * params->nx] = w1;
+      cells->speeds3[ii + jj * params->nx] = w1;
+      cells->speeds4[ii + jj * params->nx] = w1;
+      cells->speeds5[ii + jj * params->nx] = w2;
+      cells->speeds6[ii + jj * params->nx] = w2;
+      cells->speeds7[ii + jj * params->nx] = w2;
+      cells->speeds8[ii + jj * params->nx] = w2;
+      obstacles[ii + jj * params->nx] = 0;
+
+      tmp_cells->speeds0[ii + jj * params->nx] = 0;
+      tmp_cells->speeds1[ii + jj * params->nx] = 0;
+      tmp_cells->speeds2[ii + jj * params->nx] = 0;
+      tmp_cells->speeds3[ii + jj * params->nx] = 0;
+      tmp_cells->speeds4[ii + jj * params->nx] = 0;
+      tmp_cells->speeds5[ii + jj * params->nx] = 0;
+      tmp_cells->speeds6[ii + jj * params->nx] = 0;
+      tmp_cells->speeds7[ii + jj * params->nx] = 0;
+      tmp_cells->speeds8[ii + jj * params->nx] = 0;
     }
   }
+}
+
+int load_obstacles(const char *obstaclefile, const t_param *params, int *obstacles)
+{
+  char message[1024]; /* message buffer */
+  char magic[8];      /* first bytes of the file, used to pick the format */
+  FILE *fp;           /* file pointer */
+  size_t nread;       /* no. of magic bytes actually read */
 
   /* open the obstacle data file */
-  fp = fopen(obstaclefile, "r");
+  fp = fopen(obstaclefile, "rb");
 
   if (fp == NULL)
   {
@@ -599,6 +1030,28 @@ int initialise(const char *paramfile, const char *obstaclefile,
     die(message, __LINE__, __FILE__);
   }
 
+  nread = fread(magic, 1, sizeof(magic), fp);
+  rewind(fp);
+
+  if (nread == sizeof(magic) && memcmp(magic, RLE_MAGIC, sizeof(magic)) == 0)
+    load_obstacles_rle(fp, params, obstacles);
+  else if (nread >= 2 && magic[0] == 'P' && magic[1] >= '1' && magic[1] <= '5' && magic[1] != '3')
+    load_obstacles_pnm(fp, params, obstacles);
+  else
+    load_obstacles_text(fp, params, obstacles);
+
+  /* and close the file */
+  fclose(fp);
+
+  return EXIT_SUCCESS;
+}
+
+int load_obstacles_text(FILE *fp, const t_param *params, int *obstacles)
+{
+  int xx, yy;  /* generic array indices */
+  int blocked; /* indicates whether a cell is blocked by an obstacle */
+  int retval;  /* to hold return value for checking */
+
   /* read-in the blocked cells list */
   while ((retval = fscanf(fp, "%d %d %d\n", &xx, &yy, &blocked)) != EOF)
   {
@@ -616,34 +1069,197 @@ int initialise(const char *paramfile, const char *obstaclefile,
       die("obstacle blocked value should be 1", __LINE__, __FILE__);
 
     /* assign to array */
-    (*obstacles_ptr)[xx + yy * params->nx] = blocked;
+    obstacles[xx + yy * params->nx] = blocked;
   }
 
-  /* and close the file */
-  fclose(fp);
+  return EXIT_SUCCESS;
+}
 
-  /*
-  ** allocate space to hold a record of the avarage velocities computed
-  ** at each timestep
-  */
-  *av_vels_ptr = (float *)malloc(sizeof(float) * params->maxIters);
+/*
+** Run-length encoded obstacles:
+**
+**   "D2Q9RLE1" | uint32 nx | uint32 ny | uint32 runs...
+**
+** all little-endian. The runs cover the grid in the same row major
+** order as the obstacles array, alternating open and blocked cells and
+** always starting with an (optionally zero length) open run.
+*/
+int load_obstacles_rle(FILE *fp, const t_param *params, int *obstacles)
+{
+  unsigned char header[16]; /* magic, nx, ny */
+  unsigned char buf[4096];  /* chunk of encoded runs */
+  const size_t ncells = (size_t)params->nx * params->ny;
+  size_t pos = 0;           /* next cell to be written */
+  int blocked = 0;          /* whether the current run is blocked */
+  size_t nread;
+
+  if (fread(header, 1, sizeof(header), fp) != sizeof(header))
+    die("truncated header in run-length obstacle file", __LINE__, __FILE__);
+
+  const uint32_t nx = header[8] | header[9] << 8 | header[10] << 16 | (uint32_t)header[11] << 24;
+  const uint32_t ny = header[12] | header[13] << 8 | header[14] << 16 | (uint32_t)header[15] << 24;
+
+  if (nx != (uint32_t)params->nx || ny != (uint32_t)params->ny)
+    die("run-length obstacle file dimensions do not match param file", __LINE__, __FILE__);
+
+  while ((nread = fread(buf, 1, sizeof(buf), fp)) > 0)
+  {
+    if (nread % 4 != 0)
+      die("truncated run in run-length obstacle file", __LINE__, __FILE__);
+
+    for (size_t bb = 0; bb < nread; bb += 4)
+    {
+      const size_t run = buf[bb] | buf[bb + 1] << 8 | buf[bb + 2] << 16 | (uint32_t)buf[bb + 3] << 24;
+
+      if (run > ncells - pos)
+        die("run-length obstacle file overruns the grid", __LINE__, __FILE__);
+
+      if (blocked)
+      {
+        for (size_t kk = pos; kk < pos + run; kk++)
+          obstacles[kk] = 1;
+      }
+
+      pos += run;
+      blocked = !blocked;
+    }
+  }
+
+  if (pos != ncells)
+    die("run-length obstacle file does not cover the grid", __LINE__, __FILE__);
+
+  return EXIT_SUCCESS;
+}
+
+/* skip whitespace and '#' comments between the fields of a PNM header */
+static int pnm_skip(FILE *fp)
+{
+  int ch;
+
+  while ((ch = fgetc(fp)) != EOF)
+  {
+    if (ch == '#')
+    {
+      while ((ch = fgetc(fp)) != EOF && ch != '\n')
+        ;
+    }
+    else if (ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n')
+    {
+      return ungetc(ch, fp);
+    }
+  }
+
+  return EOF;
+}
+
+int load_obstacles_pnm(FILE *fp, const t_param *params, int *obstacles)
+{
+  char type;        /* '1', '2', '4' or '5' */
+  int width, height;
+  int maxval = 1;   /* PBM has no maxval field */
+  int retval;
+
+  if (fgetc(fp) != 'P')
+    die("bad magic in image obstacle file", __LINE__, __FILE__);
+
+  type = fgetc(fp);
+
+  pnm_skip(fp);
+  retval = fscanf(fp, "%d", &width);
+  pnm_skip(fp);
+  retval += fscanf(fp, "%d", &height);
+
+  if (retval != 2)
+    die("could not read image obstacle file dimensions", __LINE__, __FILE__);
+
+  if (width != params->nx || height != params->ny)
+    die("image obstacle file dimensions do not match param file", __LINE__, __FILE__);
+
+  if (type == '2' || type == '5')
+  {
+    pnm_skip(fp);
+
+    if (fscanf(fp, "%d", &maxval) != 1 || maxval < 1 || maxval > 65535)
+      die("could not read image obstacle file maxval", __LINE__, __FILE__);
+  }
+
+  /* binary rasters start after exactly one whitespace character */
+  if (type == '4' || type == '5')
+    fgetc(fp);
+
+  const int threshold = (maxval + 1) / 2;                      /* PGM: darker than this is blocked */
+  const int sample_bytes = (maxval > 255) ? 2 : 1;              /* P5 sample width */
+  const size_t row_bytes = (type == '4') ? (size_t)(width + 7) / 8
+                                         : (size_t)width * sample_bytes;
+  unsigned char *row = (type == '4' || type == '5') ? malloc(row_bytes) : NULL;
+
+  if ((type == '4' || type == '5') && row == NULL)
+    die("cannot allocate memory for image obstacle row", __LINE__, __FILE__);
+
+  for (int rr = 0; rr < height; rr++)
+  {
+    int *line = obstacles + (size_t)(height - 1 - rr) * width;
+
+    if (type == '4' || type == '5')
+    {
+      if (fread(row, 1, row_bytes, fp) != row_bytes)
+        die("truncated raster in image obstacle file", __LINE__, __FILE__);
+    }
+
+    for (int ii = 0; ii < width; ii++)
+    {
+      int value;
+
+      switch (type)
+      {
+      case '4':
+        line[ii] = (row[ii >> 3] >> (7 - (ii & 7))) & 1;
+        continue;
+      case '5':
+        value = (sample_bytes == 2) ? (row[2 * ii] << 8 | row[2 * ii + 1]) : row[ii];
+        break;
+      case '1':
+        /* plain PBM digits need not be separated */
+        pnm_skip(fp);
+        value = fgetc(fp);
+        if (value != '0' && value != '1')
+          die("bad pixel in image obstacle file", __LINE__, __FILE__);
+        line[ii] = value - '0';
+        continue;
+      default:
+        if (fscanf(fp, "%d", &value) != 1)
+          die("bad pixel in image obstacle file", __LINE__, __FILE__);
+        break;
+      }
+
+      line[ii] = value < threshold;
+    }
+  }
+
+  free(row);
 
   return EXIT_SUCCESS;
 }
 
+void *grids_arena(const int *obstacles)
+{
+  return (char *)obstacles - GRID_OBSTACLES;
+}
+
+unsigned char *tile_map(const t_param params, const int *obstacles)
+{
+  return (unsigned char *)(obstacles + params.nx * params.ny);
+}
+
 int finalise(const t_param *params, t_speed **cells_ptr, t_speed **tmp_cells_ptr,
              int **obstacles_ptr, float **av_vels_ptr)
 {
   /*
-  ** free up allocated memory
+  ** free up allocated memory: the grids and obstacles are one arena
   */
-  _mm_free(*cells_ptr);
+  arena_destroy(grids_arena(*obstacles_ptr));
   *cells_ptr = NULL;
-
-  _mm_free(*tmp_cells_ptr);
   *tmp_cells_ptr = NULL;
-
-  _mm_free(*obstacles_ptr);
   *obstacles_ptr = NULL;
 
   free(*av_vels_ptr);
@@ -682,13 +1298,418 @@ float total_density(const t_param params, t_speed *cells)
   return total;
 }
 
-int write_values(const t_param params, t_speed *cells, int *obstacles, float *av_vels)
+#ifdef PROFILE_PHASES
+void profile_init(int nthreads)
 {
-  FILE *fp;                     /* file pointer */
-  const float c_sq = 1.f / 3.f; /* sq. of speed of sound */
-  float local_density;          /* per grid cell sum of densities */
-  float pressure;               /* fluid pressure in grid cell */
-  float u_x;                    /* x-component of velocity in grid cell */
+  profile.nthreads = nthreads;
+  profile.stats = (t_phase_stats *)_mm_malloc(sizeof(t_phase_stats) * nthreads * NPHASES, 64);
+  profile.reduce_end = (double *)_mm_malloc(sizeof(double) * nthreads * PROFILE_STRIDE, 64);
+
+  if (profile.stats == NULL || profile.reduce_end == NULL)
+    die("cannot allocate memory for phase timings", __LINE__, __FILE__);
+
+  memset(profile.stats, 0, sizeof(t_phase_stats) * nthreads * NPHASES);
+  memset(profile.reduce_end, 0, sizeof(double) * nthreads * PROFILE_STRIDE);
+}
+
+void profile_record(int thread, int phase, double seconds)
+{
+  t_phase_stats *stats = &profile.stats[thread * NPHASES + phase];
+  const double ns = seconds * 1.0e9;
+  int bin = (ns > 1.0) ? (int)(PROFILE_BINS_PER_OCTAVE * log2(ns)) : 0;
+
+  if (bin >= PROFILE_BINS)
+    bin = PROFILE_BINS - 1;
+
+  if (stats->count == 0 || seconds < stats->min)
+    stats->min = seconds;
+  if (stats->count == 0 || seconds > stats->max)
+    stats->max = seconds;
+
+  stats->sum += seconds;
+  stats->count++;
+  stats->hist[bin]++;
+}
+
+void profile_report(void)
+{
+  static const char *names[NPHASES] = {"accelerate_flow", "sweep", "reduction", "barrier wait"};
+  double sweep_max = 0.0, sweep_sum = 0.0; /* per thread sweep totals, for load imbalance */
+  int sweep_threads = 0;
+
+  printf("Phase timings per thread per step (us):\n");
+  printf("  %-16s %12s %12s %12s %12s %12s\n", "phase", "min", "mean", "max", "p99", "total (s)");
+
+  for (int phase = 0; phase < NPHASES; phase++)
+  {
+    t_phase_stats all = {0};
+
+    for (int tt = 0; tt < profile.nthreads; tt++)
+    {
+      const t_phase_stats *stats = &profile.stats[tt * NPHASES + phase];
+
+      if (stats->count == 0)
+        continue;
+
+      if (all.count == 0 || stats->min < all.min)
+        all.min = stats->min;
+      if (all.count == 0 || stats->max > all.max)
+        all.max = stats->max;
+
+      all.sum += stats->sum;
+      all.count += stats->count;
+
+      for (int bin = 0; bin < PROFILE_BINS; bin++)
+        all.hist[bin] += stats->hist[bin];
+
+      if (phase == PHASE_SWEEP)
+      {
+        sweep_sum += stats->sum;
+        sweep_max = (stats->sum > sweep_max) ? stats->sum : sweep_max;
+        sweep_threads++;
+      }
+    }
+
+    if (all.count == 0)
+      continue;
+
+    /* upper edge of the bin holding the 99th percentile sample */
+    long seen = 0;
+    int bin = 0;
+
+    for (; bin < PROFILE_BINS - 1; bin++)
+    {
+      seen += all.hist[bin];
+
+      if (seen >= (long)ceil(0.99 * all.count))
+        break;
+    }
+
+    double p99 = pow(2.0, (bin + 1) / (double)PROFILE_BINS_PER_OCTAVE) * 1.0e-9;
+    p99 = (p99 > all.max) ? all.max : p99;
+
+    printf("  %-16s %12.3lf %12.3lf %12.3lf %12.3lf %12.6lf\n", names[phase],
+           all.min * 1.0e6, all.sum / all.count * 1.0e6, all.max * 1.0e6, p99 * 1.0e6, all.sum);
+  }
+
+  if (sweep_threads > 0)
+    printf("Load imbalance (slowest/mean thread sweep):\t%.3lf\n", sweep_max / (sweep_sum / sweep_threads));
+}
+
+void profile_free(void)
+{
+  _mm_free(profile.stats);
+  _mm_free(profile.reduce_end);
+}
+#endif
+
+void trace_init(int every)
+{
+  trace.enabled = 1;
+  trace.active = 0;
+  trace.step = -1;
+  trace.every = every;
+  trace.nthreads = omp_get_max_threads();
+  trace.buffers = (t_trace_buffer *)calloc(trace.nthreads + 1, sizeof(t_trace_buffer));
+  trace.sweep_end = (double *)calloc(trace.nthreads * TRACE_STRIDE, sizeof(double));
+
+  if (trace.buffers == NULL || trace.sweep_end == NULL)
+    die("cannot allocate memory for trace", __LINE__, __FILE__);
+
+  trace.t0 = monotonic_clock();
+}
+
+void trace_span(int buffer, const char *name, double tic, double toc)
+{
+  t_trace_buffer *buf = &trace.buffers[buffer];
+
+  if (buf->count == buf->capacity)
+  {
+    buf->capacity = buf->capacity ? 2 * buf->capacity : 1024;
+    buf->events = (t_trace_event *)realloc(buf->events, sizeof(t_trace_event) * buf->capacity);
+
+    if (buf->events == NULL)
+      die("cannot allocate memory for trace events", __LINE__, __FILE__);
+  }
+
+  buf->events[buf->count].name = name;
+  buf->events[buf->count].ts = tic - trace.t0;
+  buf->events[buf->count].dur = toc - tic;
+  buf->events[buf->count].step = (buffer == TRACE_WRITER) ? -1 : trace.step;
+  buf->count++;
+}
+
+void trace_write(const char *filename)
+{
+  FILE *fp = fopen(filename, "w");
+  int first = 1;
+
+  if (fp == NULL)
+    die("could not open trace output file", __LINE__, __FILE__);
+
+  fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+  for (int bb = 0; bb <= trace.nthreads; bb++)
+  {
+    if (bb == TRACE_WRITER && trace.buffers[bb].count == 0)
+      continue;
+
+    fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"%s %d\"}}",
+            first ? "" : ",\n", bb, (bb == TRACE_WRITER) ? "av_vels writer" : "omp thread", bb);
+    first = 0;
+
+    for (int ee = 0; ee < trace.buffers[bb].count; ee++)
+    {
+      const t_trace_event *ev = &trace.buffers[bb].events[ee];
+
+      fprintf(fp, ",\n{\"name\": \"%s\", \"cat\": \"d2q9\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, "
+                  "\"ts\": %.3lf, \"dur\": %.3lf, \"args\": {\"step\": %d}}",
+              ev->name, bb, ev->ts * 1.0e6, ev->dur * 1.0e6, ev->step);
+    }
+  }
+
+  fprintf(fp, "\n]}\n");
+  fclose(fp);
+}
+
+void trace_free(void)
+{
+  for (int bb = 0; bb <= trace.nthreads; bb++)
+    free(trace.buffers[bb].events);
+
+  free(trace.buffers);
+  free(trace.sweep_end);
+  trace.enabled = 0;
+}
+
+/* the packed single precision FP_ARITH events only exist on Intel cores */
+static int cpu_is_intel(void)
+{
+  char line[256];
+  int intel = 0;
+  FILE *fp = fopen("/proc/cpuinfo", "r");
+
+  if (fp == NULL)
+    return 0;
+
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    if (strncmp(line, "vendor_id", 9) == 0)
+    {
+      intel = strstr(line, "GenuineIntel") != NULL;
+      break;
+    }
+  }
+
+  fclose(fp);
+
+  return intel;
+}
+
+void counters_open(t_counters *counters)
+{
+  struct perf_event_attr attrs[NCOUNTERS];
+  const int intel = cpu_is_intel();
+
+  memset(attrs, 0, sizeof(attrs));
+
+  for (int cc = 0; cc < NCOUNTERS; cc++)
+  {
+    attrs[cc].size = sizeof(struct perf_event_attr);
+    attrs[cc].disabled = 1;
+    attrs[cc].exclude_kernel = 1;
+    attrs[cc].exclude_hv = 1;
+    attrs[cc].read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attrs[cc].type = PERF_TYPE_RAW;
+  }
+
+  attrs[COUNTER_CYCLES].type = PERF_TYPE_HARDWARE;
+  attrs[COUNTER_CYCLES].config = PERF_COUNT_HW_CPU_CYCLES;
+  attrs[COUNTER_INSTRUCTIONS].type = PERF_TYPE_HARDWARE;
+  attrs[COUNTER_INSTRUCTIONS].config = PERF_COUNT_HW_INSTRUCTIONS;
+  attrs[COUNTER_LLC_MISSES].type = PERF_TYPE_HARDWARE;
+  attrs[COUNTER_LLC_MISSES].config = PERF_COUNT_HW_CACHE_MISSES;
+  attrs[COUNTER_DTLB_MISSES].type = PERF_TYPE_HW_CACHE;
+  attrs[COUNTER_DTLB_MISSES].config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attrs[COUNTER_FP_SCALAR].config = 0x02c7; /* umask << 8 | event */
+  attrs[COUNTER_FP_128].config = 0x08c7;
+  attrs[COUNTER_FP_256].config = 0x20c7;
+  attrs[COUNTER_FP_512].config = 0x80c7;
+
+  counters->nthreads = omp_get_max_threads();
+  counters->fds = (int *)malloc(sizeof(int) * counters->nthreads * NCOUNTERS);
+
+  if (counters->fds == NULL)
+    die("cannot allocate memory for perf counters", __LINE__, __FILE__);
+
+  /* the team below may have fewer threads than asked for, whose entries it never sets */
+  for (int ii = 0; ii < counters->nthreads * NCOUNTERS; ii++)
+    counters->fds[ii] = -1;
+
+  for (int cc = 0; cc < NCOUNTERS; cc++)
+  {
+    counters->totals[cc] = 0.0;
+    counters->available[cc] = 0;
+    counters->error[cc] = (cc >= COUNTER_FP_SCALAR && !intel) ? ENOENT : 0;
+  }
+
+#pragma omp parallel
+  {
+    const int tt = omp_get_thread_num();
+
+    for (int cc = 0; cc < NCOUNTERS; cc++)
+    {
+      int fd = -1;
+
+      if (cc < COUNTER_FP_SCALAR || intel)
+        fd = syscall(SYS_perf_event_open, &attrs[cc], 0, -1, -1, 0);
+
+#pragma omp critical
+      {
+        if (fd >= 0)
+          counters->available[cc]++;
+        else if (counters->error[cc] == 0)
+          counters->error[cc] = errno;
+      }
+
+      counters->fds[tt * NCOUNTERS + cc] = fd;
+    }
+  }
+}
+
+void counters_start(t_counters *counters)
+{
+  for (int ii = 0; ii < counters->nthreads * NCOUNTERS; ii++)
+  {
+    if (counters->fds[ii] >= 0)
+    {
+      ioctl(counters->fds[ii], PERF_EVENT_IOC_RESET, 0);
+      ioctl(counters->fds[ii], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+void counters_stop(t_counters *counters)
+{
+  for (int ii = 0; ii < counters->nthreads * NCOUNTERS; ii++)
+  {
+    if (counters->fds[ii] >= 0)
+      ioctl(counters->fds[ii], PERF_EVENT_IOC_DISABLE, 0);
+  }
+
+  for (int ii = 0; ii < counters->nthreads * NCOUNTERS; ii++)
+  {
+    uint64_t values[3]; /* count, time enabled, time running */
+
+    if (counters->fds[ii] < 0 || read(counters->fds[ii], values, sizeof(values)) != sizeof(values))
+      continue;
+
+    /* scale up if the counter was multiplexed with others */
+    counters->totals[ii % NCOUNTERS] += (values[2] > 0) ? (double)values[0] * values[1] / values[2] : 0.0;
+  }
+}
+
+void counters_report(const t_counters *counters, double updates)
+{
+  static const char *names[NCOUNTERS] = {"cycles", "instructions", "LLC misses", "dTLB load misses",
+                                         "FP scalar", "FP 128-bit", "FP 256-bit", "FP 512-bit"};
+  const double *tot = counters->totals;
+  int have[NCOUNTERS];
+
+  for (int cc = 0; cc < NCOUNTERS; cc++)
+  {
+    have[cc] = counters->available[cc] > 0;
+
+    if (!have[cc])
+      printf("Counter %s unavailable (%s)\n", names[cc], strerror(counters->error[cc]));
+    else if (counters->available[cc] < counters->nthreads)
+      printf("Counter %s only on %d of %d threads\n", names[cc], counters->available[cc], counters->nthreads);
+  }
+
+  if (have[COUNTER_CYCLES])
+    printf("Cycles:\t\t\t\t\t%.0lf\n", tot[COUNTER_CYCLES]);
+
+  if (have[COUNTER_INSTRUCTIONS])
+    printf("Instructions:\t\t\t\t%.0lf\n", tot[COUNTER_INSTRUCTIONS]);
+
+  if (have[COUNTER_CYCLES] && have[COUNTER_INSTRUCTIONS] && tot[COUNTER_CYCLES] > 0.0)
+    printf("IPC:\t\t\t\t\t%.3lf\n", tot[COUNTER_INSTRUCTIONS] / tot[COUNTER_CYCLES]);
+
+  if (have[COUNTER_LLC_MISSES])
+    printf("LLC misses per update:\t\t\t%.4lf\n", tot[COUNTER_LLC_MISSES] / updates);
+
+  if (have[COUNTER_DTLB_MISSES])
+    printf("dTLB load misses per update:\t\t%.4lf\n", tot[COUNTER_DTLB_MISSES] / updates);
+
+  if (have[COUNTER_FP_SCALAR] && have[COUNTER_FP_128] && have[COUNTER_FP_256])
+  {
+    const double p512 = have[COUNTER_FP_512] ? tot[COUNTER_FP_512] : 0.0;
+    const double instrs = tot[COUNTER_FP_SCALAR] + tot[COUNTER_FP_128] + tot[COUNTER_FP_256] + p512;
+    const double lanes = tot[COUNTER_FP_SCALAR] + 4.0 * tot[COUNTER_FP_128] + 8.0 * tot[COUNTER_FP_256] + 16.0 * p512;
+
+    if (instrs > 0.0)
+    {
+      printf("Packed FP instructions:\t\t\t%.1lf%% (128-bit %.1lf%%, 256-bit %.1lf%%, 512-bit %.1lf%%)\n",
+             100.0 * (instrs - tot[COUNTER_FP_SCALAR]) / instrs, 100.0 * tot[COUNTER_FP_128] / instrs,
+             100.0 * tot[COUNTER_FP_256] / instrs, 100.0 * p512 / instrs);
+      printf("Single precision lanes per FP instr:\t%.2lf\n", lanes / instrs);
+    }
+  }
+}
+
+void counters_close(t_counters *counters)
+{
+  for (int ii = 0; ii < counters->nthreads * NCOUNTERS; ii++)
+  {
+    if (counters->fds[ii] >= 0)
+      close(counters->fds[ii]);
+  }
+
+  free(counters->fds);
+}
+
+void report_performance(const t_param params, const t_kernel *kernel, int *obstacles, int iters, float reynolds,
+                        double init_time, double comp_time, double col_time, double tot_time)
+{
+  long fluid_cells = 0; /* no. of cells that are not obstacles */
+
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      fluid_cells += !obstacles[ii + jj * params.nx];
+    }
+  }
+
+  /* every cell is streamed each step, but only fluid cells do useful collision work */
+  const double updates = (double)params.nx * params.ny * iters;
+  const double mlups = updates / comp_time / 1.0e6;
+  const double fluid_mlups = (double)fluid_cells * iters / comp_time / 1.0e6;
+  const int bytes_per_update = kernel->bytes_per_update;
+  const double bandwidth = mlups * 1.0e6 * bytes_per_update / 1.0e9;
+
+  printf("Kernel:\t\t\t\t\t%s\n", kernel->name);
+  printf("MLUPS:\t\t\t\t\t%.3lf\n", mlups);
+  printf("Fluid MLUPS:\t\t\t\t%.3lf\n", fluid_mlups);
+  printf("Bytes per update:\t\t\t%d\n", bytes_per_update);
+  printf("Achieved bandwidth:\t\t\t%.3lf (GB/s)\n", bandwidth);
+  arena_report(grids_arena(obstacles));
+  printf("{\"kernel\": \"%s\", \"nx\": %d, \"ny\": %d, \"iters\": %d, \"threads\": %d, \"fluid_cells\": %ld, "
+         "\"reynolds\": %.12E, \"init_s\": %.6lf, \"compute_s\": %.6lf, \"collate_s\": %.6lf, \"total_s\": %.6lf, "
+         "\"mlups\": %.3lf, \"fluid_mlups\": %.3lf, \"bytes_per_update\": %d, \"bandwidth_gbs\": %.3lf}\n",
+         kernel->name, params.nx, params.ny, iters, omp_get_max_threads(), fluid_cells,
+         reynolds, init_time, comp_time, col_time, tot_time,
+         mlups, fluid_mlups, bytes_per_update, bandwidth);
+}
+
+int write_values(const t_param params, t_speed *cells, int *obstacles, float *av_vels, int iters)
+{
+  FILE *fp;                     /* file pointer */
+  const float c_sq = 1.f / 3.f; /* sq. of speed of sound */
+  float local_density;          /* per grid cell sum of densities */
+  float pressure;               /* fluid pressure in grid cell */
+  float u_x;                    /* x-component of velocity in grid cell */
   float u_y;                    /* y-component of velocity in grid cell */
   float u;                      /* norm--root of summed squares--of u_x and u_y */
 
@@ -743,6 +1764,10 @@ int write_values(const t_param params, t_speed *cells, int *obstacles, float *av
 
   fclose(fp);
 
+  /* already written by the av_vels writer thread */
+  if (av_vels == NULL)
+    return EXIT_SUCCESS;
+
   fp = fopen(AVVELSFILE, "w");
 
   if (fp == NULL)
@@ -750,7 +1775,7 @@ int write_values(const t_param params, t_speed *cells, int *obstacles, float *av
     die("could not open file output file", __LINE__, __FILE__);
   }
 
-  for (int ii = 0; ii < params.maxIters; ii++)
+  for (int ii = 0; ii < iters; ii++)
   {
     fprintf(fp, "%d:\t%.12E\n", ii, av_vels[ii]);
   }
@@ -760,16 +1785,426 @@ int write_values(const t_param params, t_speed *cells, int *obstacles, float *av
   return EXIT_SUCCESS;
 }
 
+#ifndef D2Q9_LIBRARY
+void parse_options(int argc, char *argv[], t_options *options)
+{
+  options->stream_av_vels = 0;
+  options->perf_counters = 0;
+  options->trace_file = NULL;
+  options->trace_every = 100;
+  options->kernel = NULL;
+  options->autotune = 0;
+  options->tune_cache = TUNE_CACHE;
+  options->converge_tol = 0.f;
+  options->converge_window = CONVERGE_WINDOW;
+  options->converge_stride = 0;
+  options->warm_start = 0;
+  options->warm_start_iters = 0;
+  options->result_cache = NULL;
+  options->no_pin = 0;
+
+  for (int aa = 3; aa < argc; aa++)
+  {
+    if (strcmp(argv[aa], "--stream-av-vels") == 0)
+      options->stream_av_vels = AV_STREAM_CHUNK;
+    else if (strncmp(argv[aa], "--stream-av-vels=", 17) == 0)
+    {
+      options->stream_av_vels = atoi(argv[aa] + 17);
+
+      if (options->stream_av_vels < 1)
+        die("--stream-av-vels chunk size must be positive", __LINE__, __FILE__);
+    }
+    else if (strcmp(argv[aa], "--perf-counters") == 0)
+      options->perf_counters = 1;
+    else if (strcmp(argv[aa], "--no-pin") == 0)
+      options->no_pin = 1;
+    else if (strncmp(argv[aa], "--trace=", 8) == 0)
+      options->trace_file = argv[aa] + 8;
+    else if (strncmp(argv[aa], "--trace-every=", 14) == 0)
+    {
+      options->trace_every = atoi(argv[aa] + 14);
+
+      if (options->trace_every < 1)
+        die("--trace-every must be positive", __LINE__, __FILE__);
+    }
+    else if (strcmp(argv[aa], "--autotune") == 0)
+      options->autotune = 1;
+    else if (strncmp(argv[aa], "--tune-cache=", 13) == 0)
+      options->tune_cache = argv[aa] + 13;
+    else if (strcmp(argv[aa], "--converge") == 0)
+      options->converge_tol = CONVERGE_TOL;
+    else if (strncmp(argv[aa], "--converge=", 11) == 0)
+    {
+      options->converge_tol = atof(argv[aa] + 11);
+
+      if (options->converge_tol <= 0.f)
+        die("--converge tolerance must be positive", __LINE__, __FILE__);
+    }
+    else if (strncmp(argv[aa], "--converge-window=", 18) == 0)
+    {
+      options->converge_window = atoi(argv[aa] + 18);
+
+      if (options->converge_window < 1)
+        die("--converge-window must be positive", __LINE__, __FILE__);
+    }
+    else if (strncmp(argv[aa], "--converge-stride=", 18) == 0)
+    {
+      options->converge_stride = atoi(argv[aa] + 18);
+
+      if (options->converge_stride < 1)
+        die("--converge-stride must be positive", __LINE__, __FILE__);
+    }
+    else if (strncmp(argv[aa], "--warm-start=", 13) == 0)
+    {
+      options->warm_start = atoi(argv[aa] + 13);
+
+      if (options->warm_start < 2)
+        die("--warm-start coarsening factor must be at least 2", __LINE__, __FILE__);
+    }
+    else if (strncmp(argv[aa], "--warm-start-iters=", 19) == 0)
+    {
+      options->warm_start_iters = atoi(argv[aa] + 19);
+
+      if (options->warm_start_iters < 1)
+        die("--warm-start-iters must be positive", __LINE__, __FILE__);
+    }
+    else if (strncmp(argv[aa], "--result-cache=", 15) == 0)
+      options->result_cache = argv[aa] + 15;
+    else if (strncmp(argv[aa], "--kernel=", 9) == 0)
+    {
+      options->kernel = find_kernel(argv[aa] + 9);
+
+      if (options->kernel == NULL)
+      {
+        fprintf(stderr, "unknown kernel '%s', one of:\n", argv[aa] + 9);
+        list_kernels();
+        exit(EXIT_FAILURE);
+      }
+    }
+    else
+      usage(argv[0]);
+  }
+}
+#endif
+
+void converge_init(t_converge *converge, const t_param params, const t_options *options)
+{
+  const int ncells = params.nx * params.ny;
+
+  converge->tol = options->converge_tol;
+  converge->window = options->converge_window;
+  converge->stride = options->converge_stride;
+
+  if (converge->stride == 0)
+    converge->stride = ncells > CONVERGE_SAMPLES ? ncells / CONVERGE_SAMPLES : 1;
+
+  converge->nsamples = (ncells + converge->stride - 1) / converge->stride;
+  converge->history = (float *)malloc(sizeof(float) * (converge->window + 1));
+  converge->sample = (float *)malloc(sizeof(float) * 2 * converge->nsamples);
+  converge->previous = (float *)malloc(sizeof(float) * 2 * converge->nsamples);
+
+  if (converge->history == NULL || converge->sample == NULL || converge->previous == NULL)
+    die("cannot allocate memory for the convergence monitor", __LINE__, __FILE__);
+
+  converge->steady = 0;
+  converge->sampled = 0;
+  converge->av_change = INFINITY;
+  converge->field_change = INFINITY;
+}
+
+/* velocity of the sampled cells, from a grid in any layout */
+static void converge_sample(t_converge *converge, const t_param params, const t_kernel *kernel, void *grid,
+                            int *obstacles)
+{
+  for (int ss = 0; ss < converge->nsamples; ss++)
+  {
+    const int cell = ss * converge->stride;
+    float f[NSPEEDS];
+
+    if (obstacles[cell])
+    {
+      converge->sample[2 * ss] = converge->sample[2 * ss + 1] = 0.f;
+      continue;
+    }
+
+    if (kernel->layout == LAYOUT_AOS)
+    {
+      for (int kk = 0; kk < NSPEEDS; kk++)
+        f[kk] = ((t_speed_aos *)grid)[cell].speeds[kk];
+    }
+    else if (kernel->layout == LAYOUT_AOSOA)
+    {
+      for (int kk = 0; kk < NSPEEDS; kk++)
+        f[kk] = ((t_speed_aosoa *)grid)[cell / AOSOA_WIDTH].speeds[kk][cell % AOSOA_WIDTH];
+    }
+    else
+    {
+      const t_speed *cells = grid;
+      const int at = (kernel->layout == LAYOUT_PADDED)
+                         ? cell % params.nx + cell / params.nx * PADDED_PITCH(params.nx)
+                         : cell;
+      f[0] = cells->speeds0[at];
+      f[1] = cells->speeds1[at];
+      f[2] = cells->speeds2[at];
+      f[3] = cells->speeds3[at];
+      f[4] = cells->speeds4[at];
+      f[5] = cells->speeds5[at];
+      f[6] = cells->speeds6[at];
+      f[7] = cells->speeds7[at];
+      f[8] = cells->speeds8[at];
+    }
+
+    float local_density = 0.f;
+
+    for (int kk = 0; kk < NSPEEDS; kk++)
+      local_density += f[kk];
+
+    converge->sample[2 * ss] = (f[1] + f[5] + f[8] - (f[3] + f[6] + f[7])) / local_density;
+    converge->sample[2 * ss + 1] = (f[2] + f[5] + f[6] - (f[4] + f[7] + f[8])) / local_density;
+  }
+}
+
+int converge_check(t_converge *converge, const t_param params, const t_kernel *kernel, void *grid,
+                   int *obstacles, int step, float av_vel)
+{
+  const int window = converge->window;
+
+  converge->history[step % (window + 1)] = av_vel;
+
+  if (step >= window)
+  {
+    const float earlier = converge->history[(step - window) % (window + 1)];
+    converge->av_change = fabs((double)av_vel - earlier) / (fabs((double)av_vel) * window);
+    converge->steady = converge->av_change <= converge->tol ? converge->steady + 1 : 0;
+  }
+
+  if ((step + 1) % window)
+    return 0;
+
+  /* one window on from the last field sample */
+  float *tmp = converge->previous;
+  converge->previous = converge->sample;
+  converge->sample = tmp;
+  converge_sample(converge, params, kernel, grid, obstacles);
+
+  if (converge->sampled++ == 0)
+    return 0;
+
+  double diff = 0.0;
+  double norm = 0.0;
+
+  for (int ss = 0; ss < 2 * converge->nsamples; ss++)
+  {
+    const double du = (double)converge->sample[ss] - converge->previous[ss];
+    diff += du * du;
+    norm += (double)converge->sample[ss] * converge->sample[ss];
+  }
+
+  converge->field_change = norm > 0.0 ? sqrt(diff / norm) / window : INFINITY;
+
+  /* av_vels steady for the whole of the last window, and the field with it */
+  return converge->steady >= window && converge->field_change <= converge->tol;
+}
+
+void converge_free(t_converge *converge)
+{
+  free(converge->history);
+  free(converge->sample);
+  free(converge->previous);
+}
+
+static void *av_stream_writer(void *arg)
+{
+  t_av_stream *stream = arg;
+
+  pthread_mutex_lock(&stream->lock);
+
+  for (;;)
+  {
+    while (!stream->pending && !stream->done)
+      pthread_cond_wait(&stream->cond, &stream->lock);
+
+    if (!stream->pending)
+      break;
+
+    /* the time loop cannot touch the back chunk until pending is cleared */
+    pthread_mutex_unlock(&stream->lock);
+
+    const double tic = monotonic_clock();
+
+    for (int ii = 0; ii < stream->pending; ii++)
+      fprintf(stream->fp, "%d:\t%.12E\n", stream->pending_base + ii, stream->back[ii]);
+
+    fflush(stream->fp);
+
+    if (trace.enabled)
+      trace_span(TRACE_WRITER, "av_vels write", tic, monotonic_clock());
+
+    pthread_mutex_lock(&stream->lock);
+    stream->pending = 0;
+    pthread_cond_broadcast(&stream->cond);
+  }
+
+  pthread_mutex_unlock(&stream->lock);
+
+  return NULL;
+}
+
+void av_stream_open(t_av_stream *stream, int chunk)
+{
+  stream->fp = fopen(AVVELSFILE, "w");
+
+  if (stream->fp == NULL)
+    die("could not open file output file", __LINE__, __FILE__);
+
+  stream->front = (float *)malloc(sizeof(float) * chunk);
+  stream->back = (float *)malloc(sizeof(float) * chunk);
+
+  if (stream->front == NULL || stream->back == NULL)
+    die("cannot allocate memory for av_vels chunks", __LINE__, __FILE__);
+
+  stream->chunk = chunk;
+  stream->fill = 0;
+  stream->base = 0;
+  stream->pending = 0;
+  stream->pending_base = 0;
+  stream->done = 0;
+  pthread_mutex_init(&stream->lock, NULL);
+  pthread_cond_init(&stream->cond, NULL);
+
+  if (pthread_create(&stream->writer, NULL, av_stream_writer, stream) != 0)
+    die("could not start av_vels writer thread", __LINE__, __FILE__);
+}
+
+/* hand the front chunk over to the writer, waiting if it is still busy with the last one */
+static void av_stream_flush(t_av_stream *stream)
+{
+  pthread_mutex_lock(&stream->lock);
+
+  while (stream->pending)
+    pthread_cond_wait(&stream->cond, &stream->lock);
+
+  float *tmp = stream->back;
+  stream->back = stream->front;
+  stream->front = tmp;
+  stream->pending = stream->fill;
+  stream->pending_base = stream->base;
+  pthread_cond_broadcast(&stream->cond);
+  pthread_mutex_unlock(&stream->lock);
+
+  stream->base += stream->fill;
+  stream->fill = 0;
+}
+
+void av_stream_push(t_av_stream *stream, float av_vel)
+{
+  stream->front[stream->fill++] = av_vel;
+
+  if (stream->fill == stream->chunk)
+    av_stream_flush(stream);
+}
+
+void av_stream_close(t_av_stream *stream)
+{
+  if (stream->fill)
+    av_stream_flush(stream);
+
+  pthread_mutex_lock(&stream->lock);
+  stream->done = 1;
+  pthread_cond_broadcast(&stream->cond);
+  pthread_mutex_unlock(&stream->lock);
+
+  pthread_join(stream->writer, NULL);
+  pthread_mutex_destroy(&stream->lock);
+  pthread_cond_destroy(&stream->cond);
+
+  fclose(stream->fp);
+  free(stream->front);
+  free(stream->back);
+}
+
+jmp_buf *die_jump = NULL;
+char die_message[1024];
+
 void die(const char *message, const int line, const char *file)
 {
   fprintf(stderr, "Error at line %d of file %s:\n", line, file);
   fprintf(stderr, "%s\n", message);
   fflush(stderr);
+
+  if (die_jump)
+  {
+    snprintf(die_message, sizeof(die_message), "%s", message);
+    longjmp(*die_jump, 1);
+  }
+
   exit(EXIT_FAILURE);
 }
 
+#ifndef D2Q9_LIBRARY
 void usage(const char *exe)
 {
-  fprintf(stderr, "Usage: %s <paramfile> <obstaclefile>\n", exe);
+  fprintf(stderr, "Usage: %s <paramfile> <obstaclefile> [options]\n", exe);
+  fprintf(stderr, "       %s --list-kernels\n", exe);
+  fprintf(stderr, "       %s --bench [benchmark options]\n", exe);
+  fprintf(stderr, "       %s --serve=SOCKET [--kernel=NAME]\n", exe);
+  fprintf(stderr, "       %s --submit=SOCKET <paramfile> <obstaclefile> [outdir]\n", exe);
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --stream-av-vels[=N]  write av_vels to file in chunks of N steps (default %d) as the run goes\n", AV_STREAM_CHUNK);
+  fprintf(stderr, "  --perf-counters       read cycles, instructions, LLC misses and FP vector counters around the time loop\n");
+  fprintf(stderr, "  --trace=FILE          write a Chrome trace-event timeline of the run to FILE\n");
+  fprintf(stderr, "  --trace-every=N       trace one step in every N (default 100)\n");
+  fprintf(stderr, "  --kernel=NAME         step the lattice with kernel variant NAME (default %s, or the tuned one)\n", kernels[nkernels - 1].name);
+  fprintf(stderr, "  --autotune            time kernels, thread counts, schedules and row tiles, cache and use the fastest\n");
+  fprintf(stderr, "  --tune-cache=FILE     autotuner cache (default %s)\n", TUNE_CACHE);
+  fprintf(stderr, "  --converge[=TOL]      stop once av_vels and the velocity field change by under TOL per step (default %.0E)\n", CONVERGE_TOL);
+  fprintf(stderr, "  --converge-window=N   measure the change over N steps (default %d)\n", CONVERGE_WINDOW);
+  fprintf(stderr, "  --converge-stride=N   sample one cell in N of the velocity field (default about %d samples)\n", CONVERGE_SAMPLES);
+  fprintf(stderr, "  --result-cache=DIR    reuse the output of an identical earlier run from DIR, or store this one there\n");
+  fprintf(stderr, "  --warm-start=F        start from the flow of a run on a lattice coarsened F times (e.g. 2 or 4)\n");
+  fprintf(stderr, "  --warm-start-iters=N  step limit of that run (default maxIters / F), which also stops on convergence\n");
+  fprintf(stderr, "  --no-pin              leave thread placement to the OpenMP runtime instead of pinning by NUMA node\n");
   exit(EXIT_FAILURE);
-}
\ No newline at end of file
+}
+
+void apply_tune(const t_tune *tune, t_options *options)
+{
+  char overridden[64] = ""; /* the tuned values --kernel, OMP_NUM_THREADS or OMP_SCHEDULE replaced */
+  omp_sched_t schedule;
+  int chunk;
+
+  if (getenv("OMP_NUM_THREADS") == NULL)
+    omp_set_num_threads(tune->threads);
+  else if (omp_get_max_threads() != tune->threads)
+    strcat(overridden, " threads");
+
+  omp_get_schedule(&schedule, &chunk);
+
+  if (getenv("OMP_SCHEDULE") == NULL)
+  {
+    schedule = (omp_sched_t)tune->schedule;
+    chunk = tune->chunk;
+    omp_set_schedule(schedule, chunk);
+  }
+  else if (strcmp(schedule_name(schedule), schedule_name(tune->schedule)) != 0 || chunk != tune->chunk)
+    strcat(overridden, " schedule");
+
+  if (options->kernel == NULL)
+    options->kernel = tune->kernel;
+  else if (options->kernel != tune->kernel)
+    strcat(overridden, " kernel");
+
+  /* what will run, which is the tuned configuration unless overridden */
+  printf("Tuned configuration (%s):\tkernel %s, %d threads, schedule %s, chunk %d, %.3lf MLUPS in trials%s%s\n",
+         options->tune_cache, options->kernel->name, omp_get_max_threads(), schedule_name(schedule), chunk,
+         tune->mlups, overridden[0] ? "; overridden:" : "", overridden);
+}
+
+void list_kernels(void)
+{
+  for (int kk = 0; kk < nkernels; kk++)
+    printf("%-16s %3d B/update  %s\n", kernels[kk].name, kernels[kk].bytes_per_update, kernels[kk].description);
+
+  list_fixed_sizes();
+}
+#endif
@@ -0,0 +1,456 @@
+/*
+** Types and constants shared between the d2q9-bgk driver (d2q9-bgk.c),
+** the kernel variant registry (kernels.c), the policy-based sweeps
+** (sweeps.c), the benchmark mode (bench.c), the autotuner (tune.c), the
+** multilevel warm start (warm.c), the result cache (cache.c), the
+** solver daemon (serve.c), the lattice arena (arena.c) and NUMA
+** placement (numa.c).
+*/
+
+#ifndef D2Q9_BGK_H
+#define D2Q9_BGK_H
+
+#include <stddef.h>
+#include <time.h>
+#include <setjmp.h>
+
+#define NSPEEDS 9
+#define FINALSTATEFILE "final_state.dat"
+#define AVVELSFILE "av_vels.dat"
+
+/* struct to hold the parameter values */
+typedef struct
+{
+  int nx;           /* no. of cells in x-direction */
+  int ny;           /* no. of cells in y-direction */
+  int maxIters;     /* no. of iterations */
+  int reynolds_dim; /* dimension for Reynolds number */
+  float density;    /* density per link */
+  float accel;      /* density redistribution */
+  float omega;      /* relaxation parameter */
+} t_param;
+
+/* struct to hold the 'speed' values */
+typedef struct
+{
+  float *speeds0;
+  float *speeds1;
+  float *speeds2;
+  float *speeds3;
+  float *speeds4;
+  float *speeds5;
+  float *speeds6;
+  float *speeds7;
+  float *speeds8;
+} t_speed;
+
+/* struct to hold the 'speed' values of one cell, for the array of structs kernels */
+typedef struct
+{
+  float speeds[NSPEEDS];
+} t_speed_aos;
+
+/*
+** struct to hold the 'speed' values of AOSOA_WIDTH consecutive cells,
+** for the array of structs of arrays kernels: cell ii is at
+** [ii / AOSOA_WIDTH].speeds[kk][ii % AOSOA_WIDTH], so each block keeps
+** all nine populations of its cells together in nine vector-sized runs.
+*/
+#ifndef AOSOA_WIDTH
+#define AOSOA_WIDTH 16 /* cells per block: 16 floats make one cache line per population */
+#endif
+
+typedef struct
+{
+  float speeds[NSPEEDS][AOSOA_WIDTH];
+} t_speed_aosoa;
+
+/* no. of blocks holding ncells cells */
+#define AOSOA_BLOCKS(ncells) (((ncells) + AOSOA_WIDTH - 1) / AOSOA_WIDTH)
+
+/*
+** Row pitch of the padded struct of arrays layout, in floats: nx rounded
+** up to whole cache lines, plus ROW_PAD cache lines, so that vertically
+** neighbouring cells are not a multiple of 4 KiB apart when nx is a
+** power of two.
+*/
+#ifndef ROW_PAD
+#define ROW_PAD 1
+#endif
+
+#define PADDED_PITCH(nx) (((nx) + 15) / 16 * 16 + 16 * ROW_PAD)
+
+/* lattice layouts a kernel can step */
+enum
+{
+  LAYOUT_SOA,   /* a t_speed of nine nx * ny arrays */
+  LAYOUT_AOS,   /* an nx * ny array of t_speed_aos */
+  LAYOUT_AOSOA, /* an array of AOSOA_BLOCKS(nx * ny) t_speed_aosoa */
+  LAYOUT_PADDED /* a t_speed of nine PADDED_PITCH(nx) * ny arrays, cell (ii, jj) at ii + jj * PADDED_PITCH(nx) */
+};
+
+/* collision models a kernel can implement */
+enum
+{
+  MODEL_BGK, /* the BGK model of d2q9-bgk.c, reproducing its results */
+  MODEL_TRT  /* two relaxation times: a different model, so different results */
+};
+
+/*
+** struct to hold one entry of the kernel variant registry.
+**
+** step() applies accelerate_flow() and one stream/rebound/collide
+** step, leaves the new state in *cells_ptr (swapping the two grids if
+** it wrote into the scratch one) and returns the average velocity of
+** the new state. The grids are t_speed, t_speed_aos or t_speed_aosoa,
+** per layout.
+*/
+typedef struct
+{
+  const char *name;        /* selected with --kernel=name */
+  const char *description; /* one line, for --list-kernels */
+  int layout;              /* one of LAYOUT_* */
+  int bytes_per_update;    /* memory traffic per cell per step, over all passes */
+  float (*step)(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+  int model;               /* MODEL_BGK, or another model the autotuner must never swap in */
+  int parallel;            /* 1 if step() is OpenMP parallel, so the thread count and schedule matter */
+} t_kernel;
+
+/* struct to hold the command line options given after the input files */
+typedef struct
+{
+  int stream_av_vels;     /* av_vels chunk size when streaming to file, 0 to keep them all in memory */
+  int perf_counters;      /* read hardware counters around the time loop */
+  char *trace_file;       /* Chrome trace output file, NULL for no trace */
+  int trace_every;        /* trace one step in this many */
+  const t_kernel *kernel; /* kernel variant stepping the lattice, NULL until tuned or defaulted */
+  const t_kernel *asked;  /* the kernel asked for, before kernel_for_grid() specialised it */
+  int autotune;           /* time trial configurations and cache the fastest before running */
+  char *tune_cache;       /* autotuner cache file */
+  float converge_tol;     /* relative change per step counted as steady, 0 to run all maxIters */
+  int converge_window;    /* steps the change is measured over */
+  int converge_stride;    /* cells between velocity field samples, 0 for about CONVERGE_SAMPLES samples */
+  int warm_start;         /* coarsening factor of the warm start run, 0 for none */
+  int warm_start_iters;   /* step limit of the warm start run, 0 for maxIters / warm_start */
+  char *result_cache;     /* result cache directory, NULL for no cache */
+  int no_pin;             /* leave thread placement to the OpenMP runtime */
+} t_options;
+
+/* struct to hold one configuration found by the autotuner */
+typedef struct
+{
+  const t_kernel *kernel;
+  int threads;  /* OpenMP threads */
+  int schedule; /* omp_sched_t of the row loop */
+  int chunk;    /* rows per chunk of the schedule, 0 for its default */
+  double mlups; /* trial rate of this configuration */
+} t_tune;
+
+/* struct to hold the state of the steady-state monitor */
+typedef struct
+{
+  float tol;           /* relative change per step counted as steady */
+  int window;          /* steps the change is measured over */
+  int stride;          /* cells between velocity field samples */
+  int nsamples;        /* no. of sampled cells */
+  float *history;      /* the last window + 1 av_vels, indexed by step % (window + 1) */
+  int steady;          /* no. of consecutive steps av_vels has been steady for */
+  float *sample;       /* u_x, u_y of the sampled cells at the last field check */
+  float *previous;     /* the same, one window earlier */
+  int sampled;         /* no. of field checks so far */
+  double av_change;    /* av_vels change per step at the last check */
+  double field_change; /* velocity field change per step at the last check */
+} t_converge;
+
+static const float c_sq = 1.f / 3.f; /* square of speed of sound */
+static const float c_sq_inv = 3.f;   /* square of speed of sound */
+static const float w0 = 4.f / 9.f;   /* weighting factor */
+static const float w1 = 1.f / 9.f;   /* weighting factor */
+static const float w2 = 1.f / 36.f;  /* weighting factor */
+
+/* the registry, in the order the variants were developed; the last one is the default */
+extern const t_kernel kernels[];
+extern const int nkernels;
+
+/* look a kernel up by name, NULL if there is no such kernel */
+const t_kernel *find_kernel(const char *name);
+
+/* copy a lattice between the struct of arrays layout and the others */
+void soa_to_aos(const t_param params, const t_speed *soa, t_speed_aos *aos);
+void aos_to_soa(const t_param params, const t_speed_aos *aos, t_speed *soa);
+void soa_to_aosoa(const t_param params, const t_speed *soa, t_speed_aosoa *aosoa);
+void aosoa_to_soa(const t_param params, const t_speed_aosoa *aosoa, t_speed *soa);
+void soa_to_padded(const t_param params, const t_speed *soa, t_speed *padded);
+void padded_to_soa(const t_param params, const t_speed *padded, t_speed *soa);
+
+/*
+** Hand a kernel the grids in its layout: cells and tmp_cells themselves
+** for LAYOUT_SOA, or copies of cells in the kernel's layout otherwise,
+** and build whatever it derives from the obstacles (the tile map for
+** sweep-soa-tiled). kernel_grids_close() then leaves the latest state in
+** *cells_ptr and frees any copies.
+*/
+void kernel_grids_open(const t_kernel *kernel, const t_param params, t_speed *cells, t_speed *tmp_cells,
+                       const int *obstacles, void **grid_ptr, void **tmp_grid_ptr);
+void kernel_grids_close(const t_kernel *kernel, const t_param params, t_speed **cells_ptr, t_speed **tmp_cells_ptr,
+                        void *grid, void *tmp_grid);
+
+/* the OpenMP kernel in d2q9-bgk.c */
+float current_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+
+/* the kernels generated from the policy-based sweep template (sweeps.c, sweep.h) */
+float sweep_soa_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+float sweep_soa_peeled_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+float sweep_aos_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+float sweep_aosoa_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+float sweep_soa_padded_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+float sweep_soa_stream_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+float sweep_soa_nt_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+
+/* whether sweep-soa-nt streams at this grid size: it sums av_vels in another order when it does */
+int sweep_soa_nt_streams(const t_param params);
+float sweep_soa_tiled_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+float sweep_soa_trt_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+float sweep_fixed_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+
+/*
+** The kernel compiled for this grid size if kernel is sweep-fixed and
+** the size is one it was compiled for, else kernel itself. Called once
+** the params are known, before the grids are handed to the kernel.
+*/
+const t_kernel *kernel_for_grid(const t_kernel *kernel, const t_param params);
+void list_fixed_sizes(void);
+
+/* load params, allocate memory, load obstacles & initialise fluid particle densities */
+int initialise(const char *paramfile, const char *obstaclefile, const t_options *options,
+               t_param *params, t_speed **cells_ptr, t_speed **tmp_cells_ptr,
+               int **obstacles_ptr, float **av_vels_ptr);
+
+/* the pieces of initialise() */
+int read_params(const char *paramfile, t_param *params);
+int load_obstacles(const char *obstaclefile, const t_param *params, int *obstacles);
+
+/* allocate the grids and obstacle map for params, filled as reset_grids() does */
+void allocate_grids(const t_param *params, t_speed **cells_ptr, t_speed **tmp_cells_ptr, int **obstacles_ptr);
+
+/* fill the grids with fluid at rest and clear the obstacle map */
+void reset_grids(const t_param *params, t_speed *cells, t_speed *tmp_cells, int *obstacles);
+
+/* write the final state, plus the first iters av_vels unless they are NULL because they were streamed */
+int write_values(const t_param params, t_speed *cells, int *obstacles, float *av_vels, int iters);
+
+/* calculate Reynolds number */
+float calc_reynolds(const t_param params, t_speed *cells, int *obstacles);
+
+/* finalise, including freeing up allocated memory */
+int finalise(const t_param *params, t_speed **cells_ptr, t_speed **tmp_cells_ptr,
+             int **obstacles_ptr, float **av_vels_ptr);
+
+/*
+** Steady-state monitor, enabled with --converge. The run stops once
+** both the average velocity and a sample of the velocity field have
+** changed by less than tol (relative, per step) over the last window
+** steps. av_vels is checked every step against its value one window
+** earlier; the field, one cell in every stride, only once per window,
+** as it has to be read back from the grid.
+*/
+void converge_init(t_converge *converge, const t_param params, const t_options *options);
+int converge_check(t_converge *converge, const t_param params, const t_kernel *kernel, void *grid,
+                   int *obstacles, int step, float av_vel);
+void converge_free(t_converge *converge);
+
+/*
+** Multilevel warm start (warm.c): run the problem on a lattice coarsened
+** by options->warm_start towards steady state and prolongate the result
+** into cells, in place of the fluid at rest initialise() leaves there.
+*/
+void warm_start(const t_param params, const int *obstacles, const t_options *options, t_speed *cells);
+
+/*
+** Solver daemon (serve.c): ./d2q9-bgk --serve=SOCKET stays resident and
+** runs the jobs sent to it over a Unix socket, which ./d2q9-bgk
+** --submit=SOCKET sends; see the top of serve.c for the protocol.
+*/
+int serve(int argc, char *argv[]);
+int submit(int argc, char *argv[]);
+
+/*
+** Result cache (cache.c). result_key() hashes everything the output
+** depends on into a 16 hex digit key; result_fetch() copies a cached
+** output into place, returning 0 if there is none, and result_store()
+** caches the output just written.
+*/
+void result_key(const t_param params, const int *obstacles, const t_options *options, char *key);
+int result_fetch(const char *dir, const char *key);
+void result_store(const char *dir, const char *key, const t_param params, const t_options *options);
+
+/*
+** Phase timings (-DPROFILE_PHASES) and the Chrome trace (--trace).
+** current_step() and every sweep.h kernel record accelerate_flow() on
+** the master thread, each thread's share of the sweep, and its wait at
+** the barrier ending the step; the serial ported variants in kernels.c
+** record neither. current_step() also times its own av_vels reduction,
+** which in the sweep.h kernels is part of the barrier.
+*/
+#ifdef PROFILE_PHASES
+enum
+{
+  PHASE_ACCELERATE, /* accelerate_flow(), on the master thread */
+  PHASE_SWEEP,      /* this thread's rows of the stream-collide sweep */
+  PHASE_REDUCE,     /* adding this thread's av_vels partials */
+  PHASE_BARRIER,    /* waiting for the other threads at the end of the step */
+  NPHASES
+};
+
+void profile_init(int nthreads);
+void profile_record(int thread, int phase, double seconds);
+void profile_free(void);
+
+#define PROFILE_TIC(tic) const double tic = monotonic_clock()
+#define PROFILE_RECORD(thread, phase, tic) profile_record(thread, phase, monotonic_clock() - (tic))
+#else
+#define PROFILE_TIC(tic)
+#define PROFILE_RECORD(thread, phase, tic)
+#endif
+
+/* struct to hold one complete ("ph": "X") trace event */
+typedef struct
+{
+  const char *name;
+  double ts;  /* start, seconds since the trace began */
+  double dur; /* seconds */
+  int step;   /* timestep, or -1 outside the time loop */
+} t_trace_event;
+
+/* struct to hold the events of one thread, only ever appended to by that thread */
+typedef struct
+{
+  t_trace_event *events;
+  int count;
+  int capacity;
+  char pad[48]; /* keep neighbouring threads' counters off this cache line */
+} t_trace_buffer;
+
+/* struct to hold the state of the Chrome trace written with --trace */
+typedef struct
+{
+  int enabled;             /* tracing was requested */
+  int active;              /* the current step is being traced */
+  int step;                /* the current step */
+  int every;               /* sampling interval in steps */
+  double t0;               /* clock at trace start */
+  int nthreads;            /* OpenMP threads; buffer nthreads is the av_vels writer */
+  t_trace_buffer *buffers; /* [nthreads + 1] */
+  double *sweep_end;       /* per thread end of its share of the sweep, padded to a cache line */
+} t_trace;
+
+
+
+extern t_trace trace;
+
+#define TRACE_MAIN 0                 /* buffer of the master thread */
+#define TRACE_WRITER (trace.nthreads) /* buffer of the av_vels writer thread */
+
+void trace_span(int buffer, const char *name, double tic, double toc);
+
+/* inside the sweep's parallel region: this thread's share, begun at trace_tic, has just ended */
+void phase_sweep_done(double trace_tic);
+
+/* after the region: each thread's wait at the barrier that closed it */
+void phase_region_done(void);
+
+/*
+** Benchmark mode (bench.c): ./d2q9-bgk --bench [options] sweeps thread
+** counts, grid sizes and kernel variants, see bench_usage().
+*/
+int bench(int argc, char *argv[]);
+
+/* the CPU model name from /proc/cpuinfo, or "unknown" */
+void cpu_model(char *model, int size);
+
+/*
+** Autotuner (tune.c). autotune() times trial runs of a private copy of
+** the problem and stores the fastest configuration in the cache file;
+** tune_lookup() finds the cached configuration for this problem, if any.
+*/
+void autotune(const char *paramfile, const char *obstaclefile, const char *cache, t_tune *best);
+int tune_lookup(const char *cache, const t_param params, const int *obstacles, t_tune *tune);
+const char *schedule_name(int schedule);
+
+/*
+** Lattice arena (arena.c): one 2 MiB aligned mapping on huge pages when
+** the system has them. The first ARENA_HEADER bytes are the arena's
+** own; allocate_grids() lays the grids out after them.
+*/
+#define ARENA_HEADER 64
+
+enum
+{
+  PAGES_HUGETLB, /* hugetlbfs pages, reserved in /proc/sys/vm/nr_hugepages */
+  PAGES_THP,     /* transparent huge pages, as far as the kernel finds them */
+  PAGES_SMALL    /* 4 KiB pages */
+};
+
+void *arena_create(size_t size);
+void arena_destroy(void *base);
+
+/* an arena of head bytes (counting the header) then narrays staggered arrays of bytes each, set in arrays[] */
+void *arena_create_arrays(size_t head, size_t bytes, int narrays, float **arrays);
+void arena_report(const void *base);
+
+/* the arena holding the grids allocate_grids() set up around obstacles */
+void *grids_arena(const int *obstacles);
+
+/*
+** The tile activity map: one byte per TILE_SIZE x TILE_SIZE tile of the
+** grid, row major, saying whether sweep-soa-tiled can skip the tile
+** (every cell blocked, and so are all its neighbours, so nothing it holds
+** reaches a fluid cell), collide it without looking at the obstacles, or
+** must check each cell. allocate_grids() leaves room for it after the
+** obstacles, TILE_MAP_BYTES of a grid of ncells cells being enough for
+** any shape; build_tile_map() fills it in from the obstacles.
+*/
+#define TILE_SIZE 8
+#define TILES(n) (((n) + TILE_SIZE - 1) / TILE_SIZE)
+#define TILE_MAP_BYTES(ncells) ((ncells) / 8 + 1)
+
+enum
+{
+  TILE_FLUID, /* no blocked cells */
+  TILE_MIXED, /* some blocked cells, or blocked neighbours of blocked cells */
+  TILE_SOLID  /* blocked cells with blocked neighbours only */
+};
+
+unsigned char *tile_map(const t_param params, const int *obstacles);
+void build_tile_map(const t_param params, const int *obstacles);
+
+/*
+** NUMA placement (numa.c): pin the OpenMP threads, node by node in
+** thread order, before the grids are first touched, and report how many
+** rows of a struct of arrays lattice are on the node sweeping them.
+*/
+void numa_pin_threads(void);
+void numa_report(const t_param params, const t_speed *cells, const t_speed *tmp_cells, const int *obstacles);
+
+/* fraction of cells that are blocked */
+float obstacle_density(const t_param params, const int *obstacles);
+
+/* high resolution timer for the phase timings and the trace */
+static inline double monotonic_clock(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+/*
+** utility functions.
+** die() exits, unless die_jump is set, in which case it copies the
+** message to die_message and longjmp()s there instead, so the server
+** can fail one job and carry on.
+*/
+extern jmp_buf *die_jump;
+extern char die_message[1024];
+void die(const char *message, const int line, const char *file);
+
+#endif
@@ -0,0 +1,99 @@
+/*
+** libd2q9: the d2q9-bgk solver as an embeddable C library.
+**
+** Build with make lib, which gives libd2q9.a and libd2q9.so, and link
+** with -ld2q9 -fopenmp -lm. A minimal in-process run:
+**
+**   d2q9_params params;
+**   d2q9_read_params("input_128x128.params", &params);
+**   d2q9_sim *sim = d2q9_create(&params);
+**   d2q9_load_geometry(sim, "obstacles_128x128.dat");
+**   d2q9_step(sim, params.max_iters, NULL);
+**   d2q9_fields fields;
+**   d2q9_get_fields(sim, &fields);   (read fields.u_x[ii + jj * nx] ...)
+**   d2q9_destroy(sim);
+**
+** Functions returning int give 0 on success and -1 on failure, and
+** those returning a pointer give NULL; d2q9_error() then says why
+** (the solver also prints the message on stderr). Errors never exit
+** the process. The library is not thread safe: call it from one thread
+** at a time (each call uses OpenMP internally).
+**
+** python/d2q9.py wraps libd2q9.so for Python, with the arrays below as
+** numpy views.
+*/
+
+#ifndef D2Q9_H
+#define D2Q9_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define D2Q9_NSPEEDS 9
+
+/* the values of a parameter file */
+typedef struct
+{
+  int nx;           /* no. of cells in x-direction */
+  int ny;           /* no. of cells in y-direction */
+  int max_iters;    /* no. of iterations, for the caller; d2q9_step() takes its own count */
+  int reynolds_dim; /* dimension for Reynolds number */
+  float density;    /* density per link */
+  float accel;      /* density redistribution */
+  float omega;      /* relaxation parameter */
+} d2q9_params;
+
+/*
+** Zero-copy views of the state, all nx * ny arrays in row major order
+** (cell (ii, jj) at ii + jj * nx). They stay valid until the next call
+** to d2q9_step(), d2q9_get_fields() or d2q9_destroy() on the simulation.
+*/
+typedef struct
+{
+  int nx;
+  int ny;
+  const float *speeds[D2Q9_NSPEEDS]; /* the populations, numbered as in d2q9-bgk.c */
+  const int *obstacles;              /* nonzero where blocked */
+  const float *density;              /* macroscopic density, 0 in blocked cells */
+  const float *u_x;                  /* x velocity, 0 in blocked cells */
+  const float *u_y;                  /* y velocity, 0 in blocked cells */
+  const float *pressure;             /* density * c_sq, the initial density's in blocked cells */
+} d2q9_fields;
+
+typedef struct d2q9_sim d2q9_sim;
+
+/* read a d2q9-bgk parameter file */
+int d2q9_read_params(const char *paramfile, d2q9_params *params);
+
+/* a simulation with fluid at rest and no obstacles, stepped by the default kernel */
+d2q9_sim *d2q9_create(const d2q9_params *params);
+
+/* replace the obstacles, from a file in any format d2q9-bgk reads, or from a nx * ny mask */
+int d2q9_load_geometry(d2q9_sim *sim, const char *obstaclefile);
+int d2q9_set_geometry(d2q9_sim *sim, const unsigned char *mask);
+
+/* pick a kernel variant by name (see ./d2q9-bgk --list-kernels) */
+int d2q9_set_kernel(d2q9_sim *sim, const char *name);
+
+/* advance n steps, storing each step's average velocity in av_vels[0..n-1] unless it is NULL */
+int d2q9_step(d2q9_sim *sim, int n, float *av_vels);
+
+/* the populations and obstacles as they are, plus the macroscopic fields computed from them, as in final_state.dat */
+int d2q9_get_fields(d2q9_sim *sim, d2q9_fields *fields);
+
+/* no. of steps taken, and the average velocity and Reynolds number of the current state */
+int d2q9_steps(const d2q9_sim *sim);
+float d2q9_av_velocity(const d2q9_sim *sim);
+float d2q9_reynolds(const d2q9_sim *sim);
+
+void d2q9_destroy(d2q9_sim *sim);
+
+/* why the last call failed */
+const char *d2q9_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
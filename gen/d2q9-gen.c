@@ -0,0 +1,472 @@
+/*
+** Procedural obstacle generator.
+**
+** Writes an obstacle map and a matching parameter file for any grid
+** size, so benchmark corpora beyond the four shipped grids can be
+** regenerated exactly from the command line:
+**
+**   ./d2q9-gen porous --nx=4096 --ny=4096 --solid-fraction=0.4 --seed=7
+**
+** writes obstacles_porous_4096x4096.dat and input_porous_4096x4096.params,
+** which ./d2q9-bgk and make bench BENCH_GRIDS=porous_4096x4096 read.
+**
+** Kinds of map:
+**  - porous: random grains (discs, or single cells with radius 0) at
+**    uniformly random, periodically wrapped centres, added until the
+**    blocked fraction reaches the target
+**  - channel: solid walls along the bottom and top rows
+**  - cylinders: a channel with a (optionally staggered) array of cylinders
+**  - box: a lid-driven cavity; walls on the left, right and bottom, and
+**    an open band of rows along the top, containing the accelerated row
+**    ny - 2, which drags the fluid in the cavity round
+**
+** The random generator is a fixed xorshift so a seed gives the same
+** map on every platform.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define RLE_MAGIC "D2Q9RLE1"
+#define NAME_LEN 256
+
+enum
+{
+  FORMAT_TEXT, /* "x y 1" triplets, as the shipped obstacle files */
+  FORMAT_RLE,  /* run-length encoded binary */
+  FORMAT_PBM   /* P4 bitmap */
+};
+
+/* struct to hold the generator options */
+typedef struct
+{
+  const char *kind;
+  int nx;
+  int ny;
+  char name[NAME_LEN]; /* files are obstacles_<name>.dat and input_<name>.params */
+  int format;          /* one of FORMAT_*, -1 to pick by size */
+  uint64_t seed;
+  double solid_fraction; /* porous: target blocked fraction */
+  int grain_radius;      /* porous: grain radius in cells, 0 for single cells */
+  int wall;              /* channel, cylinders, box: wall thickness */
+  int radius;            /* cylinders: radius, 0 for ny / 16 */
+  int spacing;           /* cylinders: centre spacing, 0 for 4 * radius */
+  int stagger;           /* cylinders: offset alternate columns by half the spacing */
+  int lid;               /* box: rows of the open band along the top, 0 for ny / 8 */
+  int iters;             /* params: maxIters */
+  int reynolds_dim;      /* params: reynolds_dim */
+  double density;        /* params: density */
+  double accel;          /* params: accel */
+  double omega;          /* params: omega */
+} t_gen_options;
+
+void usage(const char *exe);
+void die(const char *message, const int line, const char *file);
+
+void parse_options(int argc, char *argv[], t_gen_options *options);
+
+/* the map generators, which set blocked cells of a zeroed nx * ny map */
+long gen_porous(const t_gen_options *options, unsigned char *map);
+long gen_channel(const t_gen_options *options, unsigned char *map);
+long gen_cylinders(const t_gen_options *options, unsigned char *map);
+long gen_box(const t_gen_options *options, unsigned char *map);
+
+void write_obstacles(const t_gen_options *options, const unsigned char *map);
+void write_params(const t_gen_options *options);
+
+static uint64_t rng_state;
+
+/* xorshift64*, returning 32 random bits */
+static uint32_t rng_next(void)
+{
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (uint32_t)((rng_state * 2685821657736338717ULL) >> 32);
+}
+
+/* a random integer in [0, n) */
+static int rng_below(int n)
+{
+  return (int)(((uint64_t)rng_next() * (uint64_t)n) >> 32);
+}
+
+int main(int argc, char *argv[])
+{
+  t_gen_options options;
+  long blocked = 0;
+
+  parse_options(argc, argv, &options);
+
+  unsigned char *map = (unsigned char *)calloc((size_t)options.nx * options.ny, 1);
+
+  if (map == NULL)
+    die("cannot allocate memory for the obstacle map", __LINE__, __FILE__);
+
+  rng_state = options.seed ? options.seed : 0x9E3779B97F4A7C15ULL;
+
+  if (strcmp(options.kind, "porous") == 0)
+    blocked = gen_porous(&options, map);
+  else if (strcmp(options.kind, "channel") == 0)
+    blocked = gen_channel(&options, map);
+  else if (strcmp(options.kind, "cylinders") == 0)
+    blocked = gen_cylinders(&options, map);
+  else if (strcmp(options.kind, "box") == 0)
+    blocked = gen_box(&options, map);
+  else
+    usage(argv[0]);
+
+  write_obstacles(&options, map);
+  write_params(&options);
+
+  printf("%s: %dx%d, %ld blocked cells (solid fraction %.4f)\n", options.name, options.nx, options.ny,
+         blocked, (double)blocked / ((double)options.nx * options.ny));
+
+  free(map);
+
+  return EXIT_SUCCESS;
+}
+
+/* block a disc, wrapping round the periodic boundaries, returning the no. of newly blocked cells */
+static long block_disc(const t_gen_options *options, unsigned char *map, int cx, int cy, int radius)
+{
+  long added = 0;
+
+  for (int dy = -radius; dy <= radius; dy++)
+  {
+    for (int dx = -radius; dx <= radius; dx++)
+    {
+      if (dx * dx + dy * dy > radius * radius)
+        continue;
+
+      const int ii = ((cx + dx) % options->nx + options->nx) % options->nx;
+      const int jj = ((cy + dy) % options->ny + options->ny) % options->ny;
+      unsigned char *cell = &map[(size_t)jj * options->nx + ii];
+
+      added += !*cell;
+      *cell = 1;
+    }
+  }
+
+  return added;
+}
+
+/* block rows [from, to) */
+static long block_rows(const t_gen_options *options, unsigned char *map, int from, int to)
+{
+  long added = 0;
+
+  for (int jj = from; jj < to; jj++)
+  {
+    for (int ii = 0; ii < options->nx; ii++)
+    {
+      added += !map[(size_t)jj * options->nx + ii];
+      map[(size_t)jj * options->nx + ii] = 1;
+    }
+  }
+
+  return added;
+}
+
+long gen_porous(const t_gen_options *options, unsigned char *map)
+{
+  const long ncells = (long)options->nx * options->ny;
+  const long target = (long)(options->solid_fraction * ncells + 0.5);
+  long blocked = 0;
+
+  while (blocked < target)
+    blocked += block_disc(options, map, rng_below(options->nx), rng_below(options->ny), options->grain_radius);
+
+  return blocked;
+}
+
+long gen_channel(const t_gen_options *options, unsigned char *map)
+{
+  return block_rows(options, map, 0, options->wall) +
+         block_rows(options, map, options->ny - options->wall, options->ny);
+}
+
+long gen_cylinders(const t_gen_options *options, unsigned char *map)
+{
+  const int radius = options->radius ? options->radius : (options->ny / 16 > 1 ? options->ny / 16 : 1);
+  const int spacing = options->spacing ? options->spacing : 4 * radius;
+  long blocked = gen_channel(options, map);
+
+  /* centres at half a spacing from the origin, clear of the walls */
+  for (int cx = spacing / 2, column = 0; cx < options->nx; cx += spacing, column++)
+  {
+    const int offset = (options->stagger && (column % 2)) ? spacing / 2 : 0;
+
+    for (int cy = spacing / 2 + offset; cy < options->ny; cy += spacing)
+    {
+      if (cy - radius < options->wall || cy + radius >= options->ny - options->wall)
+        continue;
+
+      blocked += block_disc(options, map, cx, cy, radius);
+    }
+  }
+
+  return blocked;
+}
+
+long gen_box(const t_gen_options *options, unsigned char *map)
+{
+  const int lid = options->lid ? options->lid : (options->ny / 8 > 2 ? options->ny / 8 : 2);
+  const int top = options->ny - lid; /* first row of the open band */
+  long blocked = block_rows(options, map, 0, options->wall);
+
+  if (top <= options->wall)
+    die("box: --lid and --wall leave no cavity", __LINE__, __FILE__);
+
+  for (int jj = options->wall; jj < top; jj++)
+  {
+    for (int ww = 0; ww < options->wall; ww++)
+    {
+      blocked += !map[(size_t)jj * options->nx + ww];
+      map[(size_t)jj * options->nx + ww] = 1;
+      blocked += !map[(size_t)jj * options->nx + options->nx - 1 - ww];
+      map[(size_t)jj * options->nx + options->nx - 1 - ww] = 1;
+    }
+  }
+
+  return blocked;
+}
+
+static void put_u32(unsigned char *buf, uint32_t value)
+{
+  buf[0] = value & 0xff;
+  buf[1] = (value >> 8) & 0xff;
+  buf[2] = (value >> 16) & 0xff;
+  buf[3] = (value >> 24) & 0xff;
+}
+
+void write_obstacles(const t_gen_options *options, const unsigned char *map)
+{
+  char filename[NAME_LEN + 32];
+  const size_t ncells = (size_t)options->nx * options->ny;
+
+  sprintf(filename, "obstacles_%s.dat", options->name);
+  FILE *fp = fopen(filename, "wb");
+
+  if (fp == NULL)
+    die("could not open obstacle output file", __LINE__, __FILE__);
+
+  if (options->format == FORMAT_TEXT)
+  {
+    for (int jj = 0; jj < options->ny; jj++)
+    {
+      for (int ii = 0; ii < options->nx; ii++)
+      {
+        if (map[(size_t)jj * options->nx + ii])
+          fprintf(fp, "%d %d 1\n", ii, jj);
+      }
+    }
+  }
+  else if (options->format == FORMAT_RLE)
+  {
+    unsigned char buf[4];
+    size_t pos = 0;
+    unsigned char blocked = 0; /* runs alternate open, blocked, open, ... */
+
+    fwrite(RLE_MAGIC, 1, 8, fp);
+    put_u32(buf, options->nx);
+    fwrite(buf, 1, 4, fp);
+    put_u32(buf, options->ny);
+    fwrite(buf, 1, 4, fp);
+
+    while (pos < ncells)
+    {
+      size_t run = 0;
+
+      while (pos + run < ncells && map[pos + run] == blocked)
+        run++;
+
+      put_u32(buf, (uint32_t)run);
+      fwrite(buf, 1, 4, fp);
+      pos += run;
+      blocked = !blocked;
+    }
+  }
+  else
+  {
+    /* P4 rows are top first, packed most significant bit first */
+    const int row_bytes = (options->nx + 7) / 8;
+    unsigned char *row = (unsigned char *)malloc(row_bytes);
+
+    if (row == NULL)
+      die("cannot allocate memory for a bitmap row", __LINE__, __FILE__);
+
+    fprintf(fp, "P4\n%d %d\n", options->nx, options->ny);
+
+    for (int jj = options->ny - 1; jj >= 0; jj--)
+    {
+      memset(row, 0, row_bytes);
+
+      for (int ii = 0; ii < options->nx; ii++)
+      {
+        if (map[(size_t)jj * options->nx + ii])
+          row[ii / 8] |= 0x80 >> (ii % 8);
+      }
+
+      fwrite(row, 1, row_bytes, fp);
+    }
+
+    free(row);
+  }
+
+  if (ferror(fp) || fclose(fp) != 0)
+    die("could not write obstacle output file", __LINE__, __FILE__);
+
+  printf("Wrote %s\n", filename);
+}
+
+void write_params(const t_gen_options *options)
+{
+  char filename[NAME_LEN + 32];
+
+  sprintf(filename, "input_%s.params", options->name);
+  FILE *fp = fopen(filename, "w");
+
+  if (fp == NULL)
+    die("could not open params output file", __LINE__, __FILE__);
+
+  fprintf(fp, "%d\n%d\n%d\n%d\n%g\n%g\n%g\n", options->nx, options->ny, options->iters,
+          options->reynolds_dim, options->density, options->accel, options->omega);
+
+  if (fclose(fp) != 0)
+    die("could not write params output file", __LINE__, __FILE__);
+
+  printf("Wrote %s\n", filename);
+}
+
+void parse_options(int argc, char *argv[], t_gen_options *options)
+{
+  const char *format = NULL;
+  const char *name = NULL;
+
+  if (argc < 2 || argv[1][0] == '-')
+    usage(argv[0]);
+
+  memset(options, 0, sizeof(*options));
+  options->kind = argv[1];
+  options->format = -1;
+  options->seed = 1;
+  options->solid_fraction = 0.3;
+  options->grain_radius = 2;
+  options->wall = 1;
+  options->iters = 20000;
+  options->reynolds_dim = 10;
+  options->density = 0.1;
+  options->accel = 0.005;
+  options->omega = 1.85;
+
+  for (int aa = 2; aa < argc; aa++)
+  {
+    const char *arg = argv[aa];
+    const char *value = strchr(arg, '=');
+
+    if (strncmp(arg, "--", 2) != 0 || value == NULL)
+      usage(argv[0]);
+
+    value++;
+
+    if (strncmp(arg, "--nx=", 5) == 0)
+      options->nx = atoi(value);
+    else if (strncmp(arg, "--ny=", 5) == 0)
+      options->ny = atoi(value);
+    else if (strncmp(arg, "--name=", 7) == 0)
+      name = value;
+    else if (strncmp(arg, "--format=", 9) == 0)
+      format = value;
+    else if (strncmp(arg, "--seed=", 7) == 0)
+      options->seed = strtoull(value, NULL, 10);
+    else if (strncmp(arg, "--solid-fraction=", 17) == 0)
+      options->solid_fraction = atof(value);
+    else if (strncmp(arg, "--grain-radius=", 15) == 0)
+      options->grain_radius = atoi(value);
+    else if (strncmp(arg, "--wall=", 7) == 0)
+      options->wall = atoi(value);
+    else if (strncmp(arg, "--radius=", 9) == 0)
+      options->radius = atoi(value);
+    else if (strncmp(arg, "--spacing=", 10) == 0)
+      options->spacing = atoi(value);
+    else if (strncmp(arg, "--stagger=", 10) == 0)
+      options->stagger = atoi(value);
+    else if (strncmp(arg, "--lid=", 6) == 0)
+      options->lid = atoi(value);
+    else if (strncmp(arg, "--iters=", 8) == 0)
+      options->iters = atoi(value);
+    else if (strncmp(arg, "--reynolds-dim=", 15) == 0)
+      options->reynolds_dim = atoi(value);
+    else if (strncmp(arg, "--density=", 10) == 0)
+      options->density = atof(value);
+    else if (strncmp(arg, "--accel=", 8) == 0)
+      options->accel = atof(value);
+    else if (strncmp(arg, "--omega=", 8) == 0)
+      options->omega = atof(value);
+    else
+      usage(argv[0]);
+  }
+
+  if (options->nx < 3 || options->ny < 3)
+    die("--nx and --ny must be at least 3", __LINE__, __FILE__);
+
+  if (options->solid_fraction < 0.0 || options->solid_fraction > 0.95)
+    die("--solid-fraction must be between 0 and 0.95", __LINE__, __FILE__);
+
+  if (options->grain_radius < 0 || options->wall < 1 || options->radius < 0 || options->spacing < 0 ||
+      options->lid < 0 || options->iters < 1)
+    die("sizes and --iters must not be negative, and --wall at least 1", __LINE__, __FILE__);
+
+  if (2 * options->wall >= options->ny)
+    die("--wall leaves no fluid rows", __LINE__, __FILE__);
+
+  if (format == NULL)
+    /* text as the shipped files up to 1024x1024; beyond that it runs to hundreds of MB */
+    options->format = ((long)options->nx * options->ny <= 1024L * 1024L) ? FORMAT_TEXT : FORMAT_RLE;
+  else if (strcmp(format, "text") == 0)
+    options->format = FORMAT_TEXT;
+  else if (strcmp(format, "rle") == 0)
+    options->format = FORMAT_RLE;
+  else if (strcmp(format, "pbm") == 0)
+    options->format = FORMAT_PBM;
+  else
+    die("--format must be text, rle or pbm", __LINE__, __FILE__);
+
+  if (name)
+    snprintf(options->name, NAME_LEN, "%s", name);
+  else
+    snprintf(options->name, NAME_LEN, "%s_%dx%d", options->kind, options->nx, options->ny);
+}
+
+void die(const char *message, const int line, const char *file)
+{
+  fprintf(stderr, "Error at line %d of file %s:\n", line, file);
+  fprintf(stderr, "%s\n", message);
+  fflush(stderr);
+  exit(EXIT_FAILURE);
+}
+
+void usage(const char *exe)
+{
+  fprintf(stderr, "Usage: %s <porous|channel|cylinders|box> --nx=N --ny=N [options]\n", exe);
+  fprintf(stderr, "Writes obstacles_<name>.dat and input_<name>.params, <name> defaulting to <kind>_<nx>x<ny>.\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --name=NAME            output file name stem\n");
+  fprintf(stderr, "  --format=FMT           text, rle or pbm (default text up to 1024x1024, rle above)\n");
+  fprintf(stderr, "  --seed=N               random seed (default 1)\n");
+  fprintf(stderr, "  --solid-fraction=F     porous: target blocked fraction (default 0.3)\n");
+  fprintf(stderr, "  --grain-radius=R       porous: grain radius, 0 for single cells (default 2)\n");
+  fprintf(stderr, "  --wall=W               channel, cylinders, box: wall thickness (default 1)\n");
+  fprintf(stderr, "  --radius=R             cylinders: radius (default ny / 16)\n");
+  fprintf(stderr, "  --spacing=S            cylinders: centre spacing (default 4 * radius)\n");
+  fprintf(stderr, "  --stagger=1            cylinders: offset alternate columns by half a spacing\n");
+  fprintf(stderr, "  --lid=L                box: rows of the open band along the top (default ny / 8)\n");
+  fprintf(stderr, "  --iters=N --reynolds-dim=N --density=F --accel=F --omega=F\n");
+  fprintf(stderr, "                         params file values (default 20000 10 0.1 0.005 1.85)\n");
+  exit(EXIT_FAILURE);
+}
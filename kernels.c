@@ -0,0 +1,974 @@
+/*
+** The kernel variant registry.
+**
+** Each stage of the optimisation of d2q9-bgk.c used to live in a fork
+** of the whole program (original.c, 1.c ... 5.c, vector_done.c). The
+** timestep of each is kept here instead, behind the common t_kernel
+** interface, so any of them can be run and timed by the one driver:
+**
+**   ./d2q9-bgk input.params obstacles.dat --kernel=fused-loops
+**
+** The variants are ported as they were, apart from taking their grids
+** through the registry interface and doing the pointer swap (which
+** used to be in main) themselves. The serial ones stay serial.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <immintrin.h> /* _mm_malloc() and _mm_free() */
+
+#include "d2q9-bgk.h"
+
+static float original_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+static float removed_divides_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+static float fused_loops_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+static float fused_av_vels_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+static float soa_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+static float vectorised_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles);
+
+/*
+** Bytes per update count the memory traffic of one cell over every
+** pass the variant makes: 9 speeds read and/or written per grid pass
+** and the obstacle flag read per pass that looks at it. The separate
+** propagate, rebound and collision passes of the first two variants
+** plus their av_velocity() pass come to 192 bytes, the fused sweep
+** plus av_velocity() to 116, and a single fused pass to 76.
+*/
+const t_kernel kernels[] = {
+    {"original", "array of structs; separate propagate, rebound and collision passes, then av_velocity (original.c)", LAYOUT_AOS, 192, original_step},
+    {"removed-divides", "as original, with the divides by c_sq in collision replaced by multiplies (1.c)", LAYOUT_AOS, 192, removed_divides_step},
+    {"fused-loops", "array of structs; one fused propagate/rebound/collision sweep, then av_velocity (2.c)", LAYOUT_AOS, 116, fused_loops_step},
+    {"fused-av-vels", "array of structs; av_vels accumulated in the fused sweep (3.c)", LAYOUT_AOS, 76, fused_av_vels_step},
+    {"soa", "struct of arrays; serial fused sweep (4.c)", LAYOUT_SOA, 76, soa_step},
+    {"vectorised", "struct of arrays; serial fused sweep with an omp simd inner loop (vector_done.c, 5.c)", LAYOUT_SOA, 76, vectorised_step},
+    {"sweep-soa", "sweep template: struct of arrays, BGK, periodic wrap per cell; timestep() without instrumentation", LAYOUT_SOA, 76, sweep_soa_step, MODEL_BGK, 1},
+    {"sweep-soa-peeled", "sweep template: as sweep-soa, edge columns peeled so the inner loop has no wrap", LAYOUT_SOA, 76, sweep_soa_peeled_step, MODEL_BGK, 1},
+    {"sweep-aos", "sweep template: array of structs, BGK, OpenMP parallel", LAYOUT_AOS, 76, sweep_aos_step, MODEL_BGK, 1},
+    {"sweep-fixed", "sweep template: as sweep-soa-peeled, compiled for each grid size in SIZES, generic for the rest", LAYOUT_SOA, 76, sweep_fixed_step, MODEL_BGK, 1},
+    {"sweep-soa-padded", "sweep template: as sweep-soa-peeled, rows padded to PADDED_PITCH(nx) floats against cache set aliasing", LAYOUT_PADDED, 76, sweep_soa_padded_step, MODEL_BGK, 1},
+    {"sweep-soa-nt", "sweep template: as sweep-soa-peeled, non-temporal stores to the new grid when the grids outgrow the stream threshold", LAYOUT_SOA, 76, sweep_soa_nt_step, MODEL_BGK, 1},
+    {"sweep-soa-tiled", "sweep template: as sweep-soa-peeled, skipping solid 8x8 tiles and not checking obstacles in fluid ones", LAYOUT_SOA, 76, sweep_soa_tiled_step, MODEL_BGK, 1},
+    {"sweep-aosoa", "sweep template: array of structs of arrays, blocks of AOSOA_WIDTH cells, BGK, edge columns peeled", LAYOUT_AOSOA, 76, sweep_aosoa_step, MODEL_BGK, 1},
+    {"sweep-soa-trt", "sweep template: as sweep-soa with the two relaxation time collision (not BGK results)", LAYOUT_SOA, 76, sweep_soa_trt_step, MODEL_TRT, 1},
+    {"current", "struct of arrays; OpenMP parallel, vectorised fused sweep (d2q9-bgk.c)", LAYOUT_SOA, 76, current_step, MODEL_BGK, 1},
+};
+
+const int nkernels = sizeof(kernels) / sizeof(kernels[0]);
+
+const t_kernel *find_kernel(const char *name)
+{
+  for (int kk = 0; kk < nkernels; kk++)
+  {
+    if (strcmp(kernels[kk].name, name) == 0)
+      return &kernels[kk];
+  }
+
+  return NULL;
+}
+
+void soa_to_aos(const t_param params, const t_speed *soa, t_speed_aos *aos)
+{
+  for (int ii = 0; ii < params.nx * params.ny; ii++)
+  {
+    aos[ii].speeds[0] = soa->speeds0[ii];
+    aos[ii].speeds[1] = soa->speeds1[ii];
+    aos[ii].speeds[2] = soa->speeds2[ii];
+    aos[ii].speeds[3] = soa->speeds3[ii];
+    aos[ii].speeds[4] = soa->speeds4[ii];
+    aos[ii].speeds[5] = soa->speeds5[ii];
+    aos[ii].speeds[6] = soa->speeds6[ii];
+    aos[ii].speeds[7] = soa->speeds7[ii];
+    aos[ii].speeds[8] = soa->speeds8[ii];
+  }
+}
+
+void aos_to_soa(const t_param params, const t_speed_aos *aos, t_speed *soa)
+{
+  for (int ii = 0; ii < params.nx * params.ny; ii++)
+  {
+    soa->speeds0[ii] = aos[ii].speeds[0];
+    soa->speeds1[ii] = aos[ii].speeds[1];
+    soa->speeds2[ii] = aos[ii].speeds[2];
+    soa->speeds3[ii] = aos[ii].speeds[3];
+    soa->speeds4[ii] = aos[ii].speeds[4];
+    soa->speeds5[ii] = aos[ii].speeds[5];
+    soa->speeds6[ii] = aos[ii].speeds[6];
+    soa->speeds7[ii] = aos[ii].speeds[7];
+    soa->speeds8[ii] = aos[ii].speeds[8];
+  }
+}
+
+void soa_to_aosoa(const t_param params, const t_speed *soa, t_speed_aosoa *aosoa)
+{
+  const int ncells = params.nx * params.ny;
+
+  /* the lanes of the last block past the end of the grid are padding, kept finite */
+  memset(&aosoa[AOSOA_BLOCKS(ncells) - 1], 0, sizeof(t_speed_aosoa));
+
+  for (int ii = 0; ii < ncells; ii++)
+  {
+    t_speed_aosoa *block = &aosoa[ii / AOSOA_WIDTH];
+    const int lane = ii % AOSOA_WIDTH;
+
+    block->speeds[0][lane] = soa->speeds0[ii];
+    block->speeds[1][lane] = soa->speeds1[ii];
+    block->speeds[2][lane] = soa->speeds2[ii];
+    block->speeds[3][lane] = soa->speeds3[ii];
+    block->speeds[4][lane] = soa->speeds4[ii];
+    block->speeds[5][lane] = soa->speeds5[ii];
+    block->speeds[6][lane] = soa->speeds6[ii];
+    block->speeds[7][lane] = soa->speeds7[ii];
+    block->speeds[8][lane] = soa->speeds8[ii];
+  }
+}
+
+void aosoa_to_soa(const t_param params, const t_speed_aosoa *aosoa, t_speed *soa)
+{
+  for (int ii = 0; ii < params.nx * params.ny; ii++)
+  {
+    const t_speed_aosoa *block = &aosoa[ii / AOSOA_WIDTH];
+    const int lane = ii % AOSOA_WIDTH;
+
+    soa->speeds0[ii] = block->speeds[0][lane];
+    soa->speeds1[ii] = block->speeds[1][lane];
+    soa->speeds2[ii] = block->speeds[2][lane];
+    soa->speeds3[ii] = block->speeds[3][lane];
+    soa->speeds4[ii] = block->speeds[4][lane];
+    soa->speeds5[ii] = block->speeds[5][lane];
+    soa->speeds6[ii] = block->speeds[6][lane];
+    soa->speeds7[ii] = block->speeds[7][lane];
+    soa->speeds8[ii] = block->speeds[8][lane];
+  }
+}
+
+void soa_to_padded(const t_param params, const t_speed *soa, t_speed *padded)
+{
+  const int pitch = PADDED_PITCH(params.nx);
+
+  /* the sweep's schedule, so the fresh copy is first touched row by row where it will be swept */
+#pragma omp parallel for schedule(runtime)
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      padded->speeds0[ii + jj * pitch] = soa->speeds0[ii + jj * params.nx];
+      padded->speeds1[ii + jj * pitch] = soa->speeds1[ii + jj * params.nx];
+      padded->speeds2[ii + jj * pitch] = soa->speeds2[ii + jj * params.nx];
+      padded->speeds3[ii + jj * pitch] = soa->speeds3[ii + jj * params.nx];
+      padded->speeds4[ii + jj * pitch] = soa->speeds4[ii + jj * params.nx];
+      padded->speeds5[ii + jj * pitch] = soa->speeds5[ii + jj * params.nx];
+      padded->speeds6[ii + jj * pitch] = soa->speeds6[ii + jj * params.nx];
+      padded->speeds7[ii + jj * pitch] = soa->speeds7[ii + jj * params.nx];
+      padded->speeds8[ii + jj * pitch] = soa->speeds8[ii + jj * params.nx];
+    }
+  }
+}
+
+void padded_to_soa(const t_param params, const t_speed *padded, t_speed *soa)
+{
+  const int pitch = PADDED_PITCH(params.nx);
+
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      soa->speeds0[ii + jj * params.nx] = padded->speeds0[ii + jj * pitch];
+      soa->speeds1[ii + jj * params.nx] = padded->speeds1[ii + jj * pitch];
+      soa->speeds2[ii + jj * params.nx] = padded->speeds2[ii + jj * pitch];
+      soa->speeds3[ii + jj * params.nx] = padded->speeds3[ii + jj * pitch];
+      soa->speeds4[ii + jj * params.nx] = padded->speeds4[ii + jj * pitch];
+      soa->speeds5[ii + jj * params.nx] = padded->speeds5[ii + jj * pitch];
+      soa->speeds6[ii + jj * params.nx] = padded->speeds6[ii + jj * pitch];
+      soa->speeds7[ii + jj * params.nx] = padded->speeds7[ii + jj * pitch];
+      soa->speeds8[ii + jj * params.nx] = padded->speeds8[ii + jj * pitch];
+    }
+  }
+}
+
+void build_tile_map(const t_param params, const int *obstacles)
+{
+  unsigned char *tiles = tile_map(params, obstacles);
+  const int ntx = TILES(params.nx);
+  const int nty = TILES(params.ny);
+
+#pragma omp parallel for schedule(runtime)
+  for (int ty = 0; ty < nty; ty++)
+  {
+    for (int tx = 0; tx < ntx; tx++)
+    {
+      const int x0 = tx * TILE_SIZE;
+      const int y0 = ty * TILE_SIZE;
+      const int x1 = (x0 + TILE_SIZE < params.nx) ? x0 + TILE_SIZE : params.nx;
+      const int y1 = (y0 + TILE_SIZE < params.ny) ? y0 + TILE_SIZE : params.ny;
+      int blocked = 0;
+      int open_halo = 0;
+
+      /* the tile and the ring of cells around it, wrapping periodically */
+      for (int jj = y0 - 1; jj <= y1; jj++)
+      {
+        const int y = (jj + params.ny) % params.ny;
+
+        for (int ii = x0 - 1; ii <= x1; ii++)
+        {
+          const int x = (ii + params.nx) % params.nx;
+          const int obstacle = obstacles[x + y * params.nx] != 0;
+
+          if (ii >= x0 && ii < x1 && jj >= y0 && jj < y1)
+            blocked += obstacle;
+          else
+            open_halo |= !obstacle;
+        }
+      }
+
+      if (blocked == 0)
+        tiles[tx + ty * ntx] = TILE_FLUID;
+      else if (blocked == (x1 - x0) * (y1 - y0) && !open_halo)
+        tiles[tx + ty * ntx] = TILE_SOLID;
+      else
+        tiles[tx + ty * ntx] = TILE_MIXED;
+    }
+  }
+}
+
+/* point the nine speeds of grid at arrays[0..8] */
+static void speeds_from_arrays(t_speed *grid, float **arrays)
+{
+  grid->speeds0 = arrays[0];
+  grid->speeds1 = arrays[1];
+  grid->speeds2 = arrays[2];
+  grid->speeds3 = arrays[3];
+  grid->speeds4 = arrays[4];
+  grid->speeds5 = arrays[5];
+  grid->speeds6 = arrays[6];
+  grid->speeds7 = arrays[7];
+  grid->speeds8 = arrays[8];
+}
+
+void kernel_grids_open(const t_kernel *kernel, const t_param params, t_speed *cells, t_speed *tmp_cells,
+                       const int *obstacles, void **grid_ptr, void **tmp_grid_ptr)
+{
+  /* the obstacles may have changed since the last run */
+  if (kernel->step == sweep_soa_tiled_step)
+    build_tile_map(params, obstacles);
+
+  if (kernel->layout == LAYOUT_SOA)
+  {
+    *grid_ptr = cells;
+    *tmp_grid_ptr = tmp_cells;
+    return;
+  }
+
+  if (kernel->layout == LAYOUT_PADDED)
+  {
+    /* the two t_speed structs at the start of an arena, then the 18 padded arrays */
+    float *arrays[2 * NSPEEDS];
+    char *arena = arena_create_arrays(ARENA_HEADER + 2 * sizeof(t_speed),
+                                      sizeof(float) * PADDED_PITCH(params.nx) * params.ny, 2 * NSPEEDS, arrays);
+    t_speed *padded_cells = (t_speed *)(arena + ARENA_HEADER);
+    t_speed *padded_tmp_cells = padded_cells + 1;
+
+    speeds_from_arrays(padded_cells, arrays);
+    speeds_from_arrays(padded_tmp_cells, arrays + NSPEEDS);
+    soa_to_padded(params, cells, padded_cells);
+    soa_to_padded(params, cells, padded_tmp_cells);
+    *grid_ptr = padded_cells;
+    *tmp_grid_ptr = padded_tmp_cells;
+    return;
+  }
+
+  if (kernel->layout == LAYOUT_AOSOA)
+  {
+    const int nblocks = AOSOA_BLOCKS(params.nx * params.ny);
+    t_speed_aosoa *aosoa_cells = (t_speed_aosoa *)_mm_malloc(sizeof(t_speed_aosoa) * nblocks, 64);
+    t_speed_aosoa *aosoa_tmp_cells = (t_speed_aosoa *)_mm_malloc(sizeof(t_speed_aosoa) * nblocks, 64);
+
+    if (aosoa_cells == NULL || aosoa_tmp_cells == NULL)
+    {
+      /* the library carries on after die(), so do not leak the one that was allocated */
+      _mm_free(aosoa_cells);
+      _mm_free(aosoa_tmp_cells);
+      die("cannot allocate memory for array of structs of arrays grids", __LINE__, __FILE__);
+    }
+
+    soa_to_aosoa(params, cells, aosoa_cells);
+    soa_to_aosoa(params, cells, aosoa_tmp_cells);
+    *grid_ptr = aosoa_cells;
+    *tmp_grid_ptr = aosoa_tmp_cells;
+    return;
+  }
+
+  t_speed_aos *aos_cells = (t_speed_aos *)malloc(sizeof(t_speed_aos) * params.nx * params.ny);
+  t_speed_aos *aos_tmp_cells = (t_speed_aos *)malloc(sizeof(t_speed_aos) * params.nx * params.ny);
+
+  if (aos_cells == NULL || aos_tmp_cells == NULL)
+  {
+    free(aos_cells);
+    free(aos_tmp_cells);
+    die("cannot allocate memory for array of structs grids", __LINE__, __FILE__);
+  }
+
+  /* both copies start from cells, so obstacle cells (whose rest speed the fused sweeps never write) are defined */
+  soa_to_aos(params, cells, aos_cells);
+  soa_to_aos(params, cells, aos_tmp_cells);
+  *grid_ptr = aos_cells;
+  *tmp_grid_ptr = aos_tmp_cells;
+}
+
+void kernel_grids_close(const t_kernel *kernel, const t_param params, t_speed **cells_ptr, t_speed **tmp_cells_ptr,
+                        void *grid, void *tmp_grid)
+{
+  if (kernel->layout == LAYOUT_SOA)
+  {
+    *cells_ptr = grid;
+    *tmp_cells_ptr = tmp_grid;
+    return;
+  }
+
+  if (kernel->layout == LAYOUT_PADDED)
+  {
+    padded_to_soa(params, grid, *cells_ptr);
+    /* the steps swap the two structs, so the arena starts before whichever comes first */
+    arena_destroy((char *)((t_speed *)grid < (t_speed *)tmp_grid ? grid : tmp_grid) - ARENA_HEADER);
+    return;
+  }
+
+  if (kernel->layout == LAYOUT_AOSOA)
+  {
+    aosoa_to_soa(params, grid, *cells_ptr);
+    _mm_free(grid);
+    _mm_free(tmp_grid);
+    return;
+  }
+
+  aos_to_soa(params, grid, *cells_ptr);
+  free(grid);
+  free(tmp_grid);
+}
+
+/*
+** array of structs variants
+*/
+
+static void accelerate_flow_aos(const t_param params, t_speed_aos *cells, int *obstacles)
+{
+  /* compute weighting factors */
+  float w1 = params.density * params.accel / 9.f;
+  float w2 = params.density * params.accel / 36.f;
+
+  /* modify the 2nd row of the grid */
+  int jj = params.ny - 2;
+
+  for (int ii = 0; ii < params.nx; ii++)
+  {
+    /* if the cell is not occupied and
+    ** we don't send a negative density */
+    if (!obstacles[ii + jj * params.nx] && (cells[ii + jj * params.nx].speeds[3] - w1) > 0.f && (cells[ii + jj * params.nx].speeds[6] - w2) > 0.f && (cells[ii + jj * params.nx].speeds[7] - w2) > 0.f)
+    {
+      /* increase 'east-side' densities */
+      cells[ii + jj * params.nx].speeds[1] += w1;
+      cells[ii + jj * params.nx].speeds[5] += w2;
+      cells[ii + jj * params.nx].speeds[8] += w2;
+      /* decrease 'west-side' densities */
+      cells[ii + jj * params.nx].speeds[3] -= w1;
+      cells[ii + jj * params.nx].speeds[6] -= w2;
+      cells[ii + jj * params.nx].speeds[7] -= w2;
+    }
+  }
+}
+
+static void propagate_aos(const t_param params, t_speed_aos *cells, t_speed_aos *tmp_cells)
+{
+  /* loop over _all_ cells */
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      /* determine indices of axis-direction neighbours
+      ** respecting periodic boundary conditions (wrap around) */
+      int y_n = (jj + 1) % params.ny;
+      int x_e = (ii + 1) % params.nx;
+      int y_s = (jj == 0) ? (jj + params.ny - 1) : (jj - 1);
+      int x_w = (ii == 0) ? (ii + params.nx - 1) : (ii - 1);
+      /* propagate densities from neighbouring cells, following
+      ** appropriate directions of travel and writing into
+      ** scratch space grid */
+      tmp_cells[ii + jj * params.nx].speeds[0] = cells[ii + jj * params.nx].speeds[0];   /* central cell, no movement */
+      tmp_cells[ii + jj * params.nx].speeds[1] = cells[x_w + jj * params.nx].speeds[1];  /* east */
+      tmp_cells[ii + jj * params.nx].speeds[2] = cells[ii + y_s * params.nx].speeds[2];  /* north */
+      tmp_cells[ii + jj * params.nx].speeds[3] = cells[x_e + jj * params.nx].speeds[3];  /* west */
+      tmp_cells[ii + jj * params.nx].speeds[4] = cells[ii + y_n * params.nx].speeds[4];  /* south */
+      tmp_cells[ii + jj * params.nx].speeds[5] = cells[x_w + y_s * params.nx].speeds[5]; /* north-east */
+      tmp_cells[ii + jj * params.nx].speeds[6] = cells[x_e + y_s * params.nx].speeds[6]; /* north-west */
+      tmp_cells[ii + jj * params.nx].speeds[7] = cells[x_e + y_n * params.nx].speeds[7]; /* south-west */
+      tmp_cells[ii + jj * params.nx].speeds[8] = cells[x_w + y_n * params.nx].speeds[8]; /* south-east */
+    }
+  }
+}
+
+static void rebound_aos(const t_param params, t_speed_aos *cells, t_speed_aos *tmp_cells, int *obstacles)
+{
+  /* loop over the cells in the grid */
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      /* if the cell contains an obstacle */
+      if (obstacles[jj * params.nx + ii])
+      {
+        /* called after propagate, so taking values from scratch space
+        ** mirroring, and writing into main grid */
+        cells[ii + jj * params.nx].speeds[1] = tmp_cells[ii + jj * params.nx].speeds[3];
+        cells[ii + jj * params.nx].speeds[2] = tmp_cells[ii + jj * params.nx].speeds[4];
+        cells[ii + jj * params.nx].speeds[3] = tmp_cells[ii + jj * params.nx].speeds[1];
+        cells[ii + jj * params.nx].speeds[4] = tmp_cells[ii + jj * params.nx].speeds[2];
+        cells[ii + jj * params.nx].speeds[5] = tmp_cells[ii + jj * params.nx].speeds[7];
+        cells[ii + jj * params.nx].speeds[6] = tmp_cells[ii + jj * params.nx].speeds[8];
+        cells[ii + jj * params.nx].speeds[7] = tmp_cells[ii + jj * params.nx].speeds[5];
+        cells[ii + jj * params.nx].speeds[8] = tmp_cells[ii + jj * params.nx].speeds[6];
+      }
+    }
+  }
+}
+
+/* the collision of original.c, dividing by c_sq */
+static void collision_divides_aos(const t_param params, t_speed_aos *cells, t_speed_aos *tmp_cells, int *obstacles)
+{
+  /* loop over the cells in the grid
+  ** NB the collision step is called after
+  ** the propagate step and so values of interest
+  ** are in the scratch-space grid */
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      /* don't consider occupied cells */
+      if (!obstacles[ii + jj * params.nx])
+      {
+        /* compute local density total */
+        float local_density = 0.f;
+
+        for (int kk = 0; kk < NSPEEDS; kk++)
+        {
+          local_density += tmp_cells[ii + jj * params.nx].speeds[kk];
+        }
+
+        /* compute x velocity component */
+        float u_x = (tmp_cells[ii + jj * params.nx].speeds[1] + tmp_cells[ii + jj * params.nx].speeds[5] + tmp_cells[ii + jj * params.nx].speeds[8] - (tmp_cells[ii + jj * params.nx].speeds[3] + tmp_cells[ii + jj * params.nx].speeds[6] + tmp_cells[ii + jj * params.nx].speeds[7])) / local_density;
+        /* compute y velocity component */
+        float u_y = (tmp_cells[ii + jj * params.nx].speeds[2] + tmp_cells[ii + jj * params.nx].speeds[5] + tmp_cells[ii + jj * params.nx].speeds[6] - (tmp_cells[ii + jj * params.nx].speeds[4] + tmp_cells[ii + jj * params.nx].speeds[7] + tmp_cells[ii + jj * params.nx].speeds[8])) / local_density;
+
+        /* velocity squared */
+        float u_sq = u_x * u_x + u_y * u_y;
+
+        /* directional velocity components */
+        float u[NSPEEDS];
+        u[1] = u_x;        /* east */
+        u[2] = u_y;        /* north */
+        u[3] = -u_x;       /* west */
+        u[4] = -u_y;       /* south */
+        u[5] = u_x + u_y;  /* north-east */
+        u[6] = -u_x + u_y; /* north-west */
+        u[7] = -u_x - u_y; /* south-west */
+        u[8] = u_x - u_y;  /* south-east */
+
+        /* equilibrium densities */
+        float d_equ[NSPEEDS];
+        /* zero velocity density: weight w0 */
+        d_equ[0] = w0 * local_density * (1.f - u_sq / (2.f * c_sq));
+        /* axis speeds: weight w1 */
+        d_equ[1] = w1 * local_density * (1.f + u[1] / c_sq + (u[1] * u[1]) / (2.f * c_sq * c_sq) - u_sq / (2.f * c_sq));
+        d_equ[2] = w1 * local_density * (1.f + u[2] / c_sq + (u[2] * u[2]) / (2.f * c_sq * c_sq) - u_sq / (2.f * c_sq));
+        d_equ[3] = w1 * local_density * (1.f + u[3] / c_sq + (u[3] * u[3]) / (2.f * c_sq * c_sq) - u_sq / (2.f * c_sq));
+        d_equ[4] = w1 * local_density * (1.f + u[4] / c_sq + (u[4] * u[4]) / (2.f * c_sq * c_sq) - u_sq / (2.f * c_sq));
+        /* diagonal speeds: weight w2 */
+        d_equ[5] = w2 * local_density * (1.f + u[5] / c_sq + (u[5] * u[5]) / (2.f * c_sq * c_sq) - u_sq / (2.f * c_sq));
+        d_equ[6] = w2 * local_density * (1.f + u[6] / c_sq + (u[6] * u[6]) / (2.f * c_sq * c_sq) - u_sq / (2.f * c_sq));
+        d_equ[7] = w2 * local_density * (1.f + u[7] / c_sq + (u[7] * u[7]) / (2.f * c_sq * c_sq) - u_sq / (2.f * c_sq));
+        d_equ[8] = w2 * local_density * (1.f + u[8] / c_sq + (u[8] * u[8]) / (2.f * c_sq * c_sq) - u_sq / (2.f * c_sq));
+
+        /* relaxation step */
+        for (int kk = 0; kk < NSPEEDS; kk++)
+        {
+          cells[ii + jj * params.nx].speeds[kk] = tmp_cells[ii + jj * params.nx].speeds[kk] + params.omega * (d_equ[kk] - tmp_cells[ii + jj * params.nx].speeds[kk]);
+        }
+      }
+    }
+  }
+}
+
+/* the collision of 1.c, multiplying by c_sq_inv */
+static void collision_aos(const t_param params, t_speed_aos *cells, t_speed_aos *tmp_cells, int *obstacles)
+{
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      /* don't consider occupied cells */
+      if (!obstacles[ii + jj * params.nx])
+      {
+        /* compute local density total */
+        float local_density = 0.f;
+
+        for (int kk = 0; kk < NSPEEDS; kk++)
+        {
+          local_density += tmp_cells[ii + jj * params.nx].speeds[kk];
+        }
+
+        /* compute x velocity component */
+        float u_x = (tmp_cells[ii + jj * params.nx].speeds[1] + tmp_cells[ii + jj * params.nx].speeds[5] + tmp_cells[ii + jj * params.nx].speeds[8] - (tmp_cells[ii + jj * params.nx].speeds[3] + tmp_cells[ii + jj * params.nx].speeds[6] + tmp_cells[ii + jj * params.nx].speeds[7])) / local_density;
+        /* compute y velocity component */
+        float u_y = (tmp_cells[ii + jj * params.nx].speeds[2] + tmp_cells[ii + jj * params.nx].speeds[5] + tmp_cells[ii + jj * params.nx].speeds[6] - (tmp_cells[ii + jj * params.nx].speeds[4] + tmp_cells[ii + jj * params.nx].speeds[7] + tmp_cells[ii + jj * params.nx].speeds[8])) / local_density;
+
+        /* velocity squared */
+        float u_sq = u_x * u_x + u_y * u_y;
+
+        /* equilibrium densities */
+        float d_equ[NSPEEDS];
+        /* zero velocity density: weight w0 */
+        d_equ[0] = w0 * local_density * (1.f - u_sq * (0.5f * c_sq_inv));
+        /* axis speeds: weight w1 */
+        d_equ[1] = w1 * local_density * (1.f + (u_x * c_sq_inv) + (u_x * u_x) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        d_equ[2] = w1 * local_density * (1.f + (u_y * c_sq_inv) + (u_y * u_y) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        d_equ[3] = w1 * local_density * (1.f + (-u_x * c_sq_inv) + (u_x * u_x) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        d_equ[4] = w1 * local_density * (1.f + (-u_y * c_sq_inv) + (u_y * u_y) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        /* diagonal speeds: weight w2 */
+        d_equ[5] = w2 * local_density * (1.f + ((u_x + u_y) * c_sq_inv) + ((u_x + u_y) * (u_x + u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        d_equ[6] = w2 * local_density * (1.f + ((-u_x + u_y) * c_sq_inv) + ((-u_x + u_y) * (-u_x + u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        d_equ[7] = w2 * local_density * (1.f + ((-u_x - u_y) * c_sq_inv) + ((-u_x - u_y) * (-u_x - u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        d_equ[8] = w2 * local_density * (1.f + ((u_x - u_y) * c_sq_inv) + ((u_x - u_y) * (u_x - u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+
+        /* relaxation step */
+        for (int kk = 0; kk < NSPEEDS; kk++)
+        {
+          cells[ii + jj * params.nx].speeds[kk] = tmp_cells[ii + jj * params.nx].speeds[kk] + params.omega * (d_equ[kk] - tmp_cells[ii + jj * params.nx].speeds[kk]);
+        }
+      }
+    }
+  }
+}
+
+static float av_velocity_aos(const t_param params, t_speed_aos *cells, int *obstacles)
+{
+  int tot_cells = 0; /* no. of cells used in calculation */
+  float tot_u;       /* accumulated magnitudes of velocity for each cell */
+
+  /* initialise */
+  tot_u = 0.f;
+
+  /* loop over all non-blocked cells */
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      /* ignore occupied cells */
+      if (!obstacles[ii + jj * params.nx])
+      {
+        /* local density total */
+        float local_density = 0.f;
+
+        for (int kk = 0; kk < NSPEEDS; kk++)
+        {
+          local_density += cells[ii + jj * params.nx].speeds[kk];
+        }
+
+        /* x-component of velocity */
+        float u_x = (cells[ii + jj * params.nx].speeds[1] + cells[ii + jj * params.nx].speeds[5] + cells[ii + jj * params.nx].speeds[8] - (cells[ii + jj * params.nx].speeds[3] + cells[ii + jj * params.nx].speeds[6] + cells[ii + jj * params.nx].speeds[7])) / local_density;
+        /* compute y velocity component */
+        float u_y = (cells[ii + jj * params.nx].speeds[2] + cells[ii + jj * params.nx].speeds[5] + cells[ii + jj * params.nx].speeds[6] - (cells[ii + jj * params.nx].speeds[4] + cells[ii + jj * params.nx].speeds[7] + cells[ii + jj * params.nx].speeds[8])) / local_density;
+        /* accumulate the norm of x- and y- velocity components */
+        tot_u += sqrtf((u_x * u_x) + (u_y * u_y));
+        /* increase counter of inspected cells */
+        ++tot_cells;
+      }
+    }
+  }
+
+  return tot_u / (float)tot_cells;
+}
+
+/*
+** Fused propagate, rebound and collision sweep of 2.c and 3.c, reading
+** cells and writing tmp_cells. Returns the average velocity of the
+** result, accumulated in the sweep, if av_vels is set and 0 otherwise.
+*/
+static float fused_sweep_aos(const t_param params, t_speed_aos *cells, t_speed_aos *tmp_cells, int *obstacles, int av_vels)
+{
+  float tot_u = 0.0f;
+  int tot_cells = 0;
+
+  /* loop over _all_ cells */
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    int y_s = (jj == 0) ? (jj + params.ny - 1) : (jj - 1);
+    int y_n = (jj + 1) % params.ny;
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      /* determine indices of axis-direction neighbours
+      ** respecting periodic boundary conditions (wrap around) */
+      int x_e = (ii + 1) % params.nx;
+      int x_w = (ii == 0) ? (ii + params.nx - 1) : (ii - 1);
+
+      /* propagate densities from neighbouring cells, following
+      ** appropriate directions of travel */
+      const float s0 = cells[ii + jj * params.nx].speeds[0];   /* central cell, no movement */
+      const float s1 = cells[x_w + jj * params.nx].speeds[1];  /* east */
+      const float s2 = cells[ii + y_s * params.nx].speeds[2];  /* north */
+      const float s3 = cells[x_e + jj * params.nx].speeds[3];  /* west */
+      const float s4 = cells[ii + y_n * params.nx].speeds[4];  /* south */
+      const float s5 = cells[x_w + y_s * params.nx].speeds[5]; /* north-east */
+      const float s6 = cells[x_e + y_s * params.nx].speeds[6]; /* north-west */
+      const float s7 = cells[x_e + y_n * params.nx].speeds[7]; /* south-west */
+      const float s8 = cells[x_w + y_n * params.nx].speeds[8]; /* south-east */
+
+      /* if the cell contains an obstacle */
+      if (obstacles[jj * params.nx + ii])
+      {
+        /* mirror the incoming densities */
+        tmp_cells[ii + jj * params.nx].speeds[1] = s3;
+        tmp_cells[ii + jj * params.nx].speeds[2] = s4;
+        tmp_cells[ii + jj * params.nx].speeds[3] = s1;
+        tmp_cells[ii + jj * params.nx].speeds[4] = s2;
+        tmp_cells[ii + jj * params.nx].speeds[5] = s7;
+        tmp_cells[ii + jj * params.nx].speeds[6] = s8;
+        tmp_cells[ii + jj * params.nx].speeds[7] = s5;
+        tmp_cells[ii + jj * params.nx].speeds[8] = s6;
+      }
+      else
+      {
+        /* compute local density total */
+        float local_density = s0 + s1 + s2 + s3 + s4 + s5 + s6 + s7 + s8;
+
+        /* compute x velocity component */
+        float u_x = (s1 + s5 + s8 - (s3 + s6 + s7)) / local_density;
+        /* compute y velocity component */
+        float u_y = (s2 + s5 + s6 - (s4 + s7 + s8)) / local_density;
+
+        /* velocity squared */
+        float u_sq = u_x * u_x + u_y * u_y;
+
+        /* equilibrium densities */
+        float d_equ[NSPEEDS];
+        /* zero velocity density: weight w0 */
+        d_equ[0] = w0 * local_density * (1.f - u_sq * (0.5f * c_sq_inv));
+        /* axis speeds: weight w1 */
+        d_equ[1] = w1 * local_density * (1.f + (u_x * c_sq_inv) + (u_x * u_x) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        d_equ[2] = w1 * local_density * (1.f + (u_y * c_sq_inv) + (u_y * u_y) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        d_equ[3] = w1 * local_density * (1.f + (-u_x * c_sq_inv) + (u_x * u_x) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        d_equ[4] = w1 * local_density * (1.f + (-u_y * c_sq_inv) + (u_y * u_y) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        /* diagonal speeds: weight w2 */
+        d_equ[5] = w2 * local_density * (1.f + ((u_x + u_y) * c_sq_inv) + ((u_x + u_y) * (u_x + u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        d_equ[6] = w2 * local_density * (1.f + ((-u_x + u_y) * c_sq_inv) + ((-u_x + u_y) * (-u_x + u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        d_equ[7] = w2 * local_density * (1.f + ((-u_x - u_y) * c_sq_inv) + ((-u_x - u_y) * (-u_x - u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        d_equ[8] = w2 * local_density * (1.f + ((u_x - u_y) * c_sq_inv) + ((u_x - u_y) * (u_x - u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+
+        tmp_cells[ii + jj * params.nx].speeds[0] = s0 + params.omega * (d_equ[0] - s0);
+        tmp_cells[ii + jj * params.nx].speeds[1] = s1 + params.omega * (d_equ[1] - s1);
+        tmp_cells[ii + jj * params.nx].speeds[2] = s2 + params.omega * (d_equ[2] - s2);
+        tmp_cells[ii + jj * params.nx].speeds[3] = s3 + params.omega * (d_equ[3] - s3);
+        tmp_cells[ii + jj * params.nx].speeds[4] = s4 + params.omega * (d_equ[4] - s4);
+        tmp_cells[ii + jj * params.nx].speeds[5] = s5 + params.omega * (d_equ[5] - s5);
+        tmp_cells[ii + jj * params.nx].speeds[6] = s6 + params.omega * (d_equ[6] - s6);
+        tmp_cells[ii + jj * params.nx].speeds[7] = s7 + params.omega * (d_equ[7] - s7);
+        tmp_cells[ii + jj * params.nx].speeds[8] = s8 + params.omega * (d_equ[8] - s8);
+
+        if (av_vels)
+        {
+          /* accumulate the norm of x- and y- velocity components */
+          tot_u += sqrtf((u_x * u_x) + (u_y * u_y));
+          /* increase counter of inspected cells */
+          ++tot_cells;
+        }
+      }
+    }
+  }
+
+  return av_vels ? tot_u / (float)tot_cells : 0.f;
+}
+
+static float original_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles)
+{
+  t_speed_aos *cells = *cells_ptr;
+  t_speed_aos *tmp_cells = *tmp_cells_ptr;
+
+  /* the result ends up back in cells, so there is nothing to swap */
+  accelerate_flow_aos(params, cells, obstacles);
+  propagate_aos(params, cells, tmp_cells);
+  rebound_aos(params, cells, tmp_cells, obstacles);
+  collision_divides_aos(params, cells, tmp_cells, obstacles);
+
+  return av_velocity_aos(params, cells, obstacles);
+}
+
+static float removed_divides_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles)
+{
+  t_speed_aos *cells = *cells_ptr;
+  t_speed_aos *tmp_cells = *tmp_cells_ptr;
+
+  accelerate_flow_aos(params, cells, obstacles);
+  propagate_aos(params, cells, tmp_cells);
+  rebound_aos(params, cells, tmp_cells, obstacles);
+  collision_aos(params, cells, tmp_cells, obstacles);
+
+  return av_velocity_aos(params, cells, obstacles);
+}
+
+static float fused_loops_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles)
+{
+  t_speed_aos *cells = *cells_ptr;
+  t_speed_aos *tmp_cells = *tmp_cells_ptr;
+
+  accelerate_flow_aos(params, cells, obstacles);
+  fused_sweep_aos(params, cells, tmp_cells, obstacles, 0);
+
+  *cells_ptr = tmp_cells;
+  *tmp_cells_ptr = cells;
+
+  return av_velocity_aos(params, tmp_cells, obstacles);
+}
+
+static float fused_av_vels_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles)
+{
+  t_speed_aos *cells = *cells_ptr;
+  t_speed_aos *tmp_cells = *tmp_cells_ptr;
+
+  accelerate_flow_aos(params, cells, obstacles);
+  const float av_vel = fused_sweep_aos(params, cells, tmp_cells, obstacles, 1);
+
+  *cells_ptr = tmp_cells;
+  *tmp_cells_ptr = cells;
+
+  return av_vel;
+}
+
+/*
+** struct of arrays variants
+*/
+
+static void accelerate_flow_soa(const t_param params, t_speed *restrict cells, int *obstacles)
+{
+  /* compute weighting factors */
+  float w1 = params.density * params.accel / 9.f;
+  float w2 = params.density * params.accel / 36.f;
+
+  /* modify the 2nd row of the grid */
+  int jj = params.ny - 2;
+
+  for (int ii = 0; ii < params.nx; ii++)
+  {
+    /* if the cell is not occupied and
+    ** we don't send a negative density */
+    if (!obstacles[ii + jj * params.nx] && (cells->speeds3[ii + jj * params.nx] - w1) > 0.f && (cells->speeds6[ii + jj * params.nx] - w2) > 0.f && (cells->speeds7[ii + jj * params.nx] - w2) > 0.f)
+    {
+      cells->speeds1[ii + jj * params.nx] += w1;
+      cells->speeds5[ii + jj * params.nx] += w2;
+      cells->speeds8[ii + jj * params.nx] += w2;
+      cells->speeds3[ii + jj * params.nx] -= w1;
+      cells->speeds6[ii + jj * params.nx] -= w2;
+      cells->speeds7[ii + jj * params.nx] -= w2;
+    }
+  }
+}
+
+static float soa_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles)
+{
+  t_speed *restrict cells = *cells_ptr;
+  t_speed *restrict tmp_cells = *tmp_cells_ptr;
+  float tot_u = 0.0f;
+  int tot_cells = 0;
+
+  accelerate_flow_soa(params, cells, obstacles);
+
+  /* loop over _all_ cells */
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    int y_s = (jj == 0) ? (jj + params.ny - 1) : (jj - 1);
+    int y_n = (jj + 1) % params.ny;
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      /* determine indices of axis-direction neighbours
+      ** respecting periodic boundary conditions (wrap around) */
+      int x_e = (ii + 1) % params.nx;
+      int x_w = (ii == 0) ? (ii + params.nx - 1) : (ii - 1);
+
+      /* propagate densities from neighbouring cells, following
+      ** appropriate directions of travel */
+      const float s0 = cells->speeds0[ii + jj * params.nx];   /* central cell, no movement */
+      const float s1 = cells->speeds1[x_w + jj * params.nx];  /* east */
+      const float s2 = cells->speeds2[ii + y_s * params.nx];  /* north */
+      const float s3 = cells->speeds3[x_e + jj * params.nx];  /* west */
+      const float s4 = cells->speeds4[ii + y_n * params.nx];  /* south */
+      const float s5 = cells->speeds5[x_w + y_s * params.nx]; /* north-east */
+      const float s6 = cells->speeds6[x_e + y_s * params.nx]; /* north-west */
+      const float s7 = cells->speeds7[x_e + y_n * params.nx]; /* south-west */
+      const float s8 = cells->speeds8[x_w + y_n * params.nx]; /* south-east */
+
+      /* if the cell contains an obstacle */
+      if (obstacles[jj * params.nx + ii])
+      {
+        tmp_cells->speeds1[ii + jj * params.nx] = s3;
+        tmp_cells->speeds2[ii + jj * params.nx] = s4;
+        tmp_cells->speeds3[ii + jj * params.nx] = s1;
+        tmp_cells->speeds4[ii + jj * params.nx] = s2;
+        tmp_cells->speeds5[ii + jj * params.nx] = s7;
+        tmp_cells->speeds6[ii + jj * params.nx] = s8;
+        tmp_cells->speeds7[ii + jj * params.nx] = s5;
+        tmp_cells->speeds8[ii + jj * params.nx] = s6;
+      }
+      else
+      {
+        /* compute local density total */
+        float local_density = s0 + s1 + s2 + s3 + s4 + s5 + s6 + s7 + s8;
+
+        /* compute x velocity component */
+        float u_x = (s1 + s5 + s8 - (s3 + s6 + s7)) / local_density;
+        /* compute y velocity component */
+        float u_y = (s2 + s5 + s6 - (s4 + s7 + s8)) / local_density;
+
+        /* velocity squared */
+        float u_sq = u_x * u_x + u_y * u_y;
+
+        /* zero velocity density: weight w0 */
+        const float d_equ0 = w0 * local_density * (1.f - u_sq * (0.5f * c_sq_inv));
+        const float d_equ1 = w1 * local_density * (1.f + (u_x * c_sq_inv) + (u_x * u_x) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ2 = w1 * local_density * (1.f + (u_y * c_sq_inv) + (u_y * u_y) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ3 = w1 * local_density * (1.f + (-u_x * c_sq_inv) + (u_x * u_x) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ4 = w1 * local_density * (1.f + (-u_y * c_sq_inv) + (u_y * u_y) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ5 = w2 * local_density * (1.f + ((u_x + u_y) * c_sq_inv) + ((u_x + u_y) * (u_x + u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ6 = w2 * local_density * (1.f + ((-u_x + u_y) * c_sq_inv) + ((-u_x + u_y) * (-u_x + u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ7 = w2 * local_density * (1.f + ((-u_x - u_y) * c_sq_inv) + ((-u_x - u_y) * (-u_x - u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ8 = w2 * local_density * (1.f + ((u_x - u_y) * c_sq_inv) + ((u_x - u_y) * (u_x - u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+
+        tmp_cells->speeds0[ii + jj * params.nx] = s0 + params.omega * (d_equ0 - s0);
+        tmp_cells->speeds1[ii + jj * params.nx] = s1 + params.omega * (d_equ1 - s1);
+        tmp_cells->speeds2[ii + jj * params.nx] = s2 + params.omega * (d_equ2 - s2);
+        tmp_cells->speeds3[ii + jj * params.nx] = s3 + params.omega * (d_equ3 - s3);
+        tmp_cells->speeds4[ii + jj * params.nx] = s4 + params.omega * (d_equ4 - s4);
+        tmp_cells->speeds5[ii + jj * params.nx] = s5 + params.omega * (d_equ5 - s5);
+        tmp_cells->speeds6[ii + jj * params.nx] = s6 + params.omega * (d_equ6 - s6);
+        tmp_cells->speeds7[ii + jj * params.nx] = s7 + params.omega * (d_equ7 - s7);
+        tmp_cells->speeds8[ii + jj * params.nx] = s8 + params.omega * (d_equ8 - s8);
+
+        /* accumulate the norm of x- and y- velocity components */
+        tot_u += sqrtf((u_x * u_x) + (u_y * u_y));
+        /* increase counter of inspected cells */
+        ++tot_cells;
+      }
+    }
+  }
+
+  *cells_ptr = tmp_cells;
+  *tmp_cells_ptr = cells;
+
+  return tot_u / (float)tot_cells;
+}
+
+/*
+** The sweep of vector_done.c, taking the speed arrays as separate
+** restrict pointers so the inner loop vectorises. Its __assume(jj != 0)
+** and __assume(jj != ny - 1) were wrong for the first and last rows
+** and are left out.
+*/
+static float vectorised_sweep(const t_param params,
+                              float *restrict cells_speeds0, float *restrict cells_speeds1, float *restrict cells_speeds2, float *restrict cells_speeds3, float *restrict cells_speeds4, float *restrict cells_speeds5, float *restrict cells_speeds6, float *restrict cells_speeds7, float *restrict cells_speeds8, float *restrict tmp_cells_speeds0, float *restrict tmp_cells_speeds1, float *restrict tmp_cells_speeds2, float *restrict tmp_cells_speeds3, float *restrict tmp_cells_speeds4, float *restrict tmp_cells_speeds5, float *restrict tmp_cells_speeds6, float *restrict tmp_cells_speeds7, float *restrict tmp_cells_speeds8,
+                              int *restrict obstacles)
+{
+  float tot_u = 0.0f;
+  int tot_cells = 0;
+
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    int y_s = (jj == 0) ? (jj + params.ny - 1) : (jj - 1);
+    int y_n = (jj == params.ny - 1) ? 0 : (jj + 1);
+#pragma omp simd reduction(+ \
+                           : tot_u, tot_cells)
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      int x_e = (ii == params.nx - 1) ? (0) : (ii + 1);
+      int x_w = (ii == 0) ? (ii + params.nx - 1) : (ii - 1);
+
+      const float s0 = cells_speeds0[ii + jj * params.nx];   /* central cell, no movement */
+      const float s1 = cells_speeds1[x_w + jj * params.nx];  /* east */
+      const float s2 = cells_speeds2[ii + y_s * params.nx];  /* north */
+      const float s3 = cells_speeds3[x_e + jj * params.nx];  /* west */
+      const float s4 = cells_speeds4[ii + y_n * params.nx];  /* south */
+      const float s5 = cells_speeds5[x_w + y_s * params.nx]; /* north-east */
+      const float s6 = cells_speeds6[x_e + y_s * params.nx]; /* north-west */
+      const float s7 = cells_speeds7[x_e + y_n * params.nx]; /* south-west */
+      const float s8 = cells_speeds8[x_w + y_n * params.nx]; /* south-east */
+
+      /* if the cell contains an obstacle */
+      if (obstacles[jj * params.nx + ii])
+      {
+        tmp_cells_speeds1[ii + jj * params.nx] = s3;
+        tmp_cells_speeds2[ii + jj * params.nx] = s4;
+        tmp_cells_speeds3[ii + jj * params.nx] = s1;
+        tmp_cells_speeds4[ii + jj * params.nx] = s2;
+        tmp_cells_speeds5[ii + jj * params.nx] = s7;
+        tmp_cells_speeds6[ii + jj * params.nx] = s8;
+        tmp_cells_speeds7[ii + jj * params.nx] = s5;
+        tmp_cells_speeds8[ii + jj * params.nx] = s6;
+      }
+      else
+      {
+        /* compute local density total */
+        float local_density = s0 + s1 + s2 + s3 + s4 + s5 + s6 + s7 + s8;
+
+        /* compute x velocity component */
+        float u_x = (s1 + s5 + s8 - (s3 + s6 + s7)) / local_density;
+        /* compute y velocity component */
+        float u_y = (s2 + s5 + s6 - (s4 + s7 + s8)) / local_density;
+
+        /* velocity squared */
+        float u_sq = u_x * u_x + u_y * u_y;
+
+        /* zero velocity density: weight w0 */
+        const float d_equ0 = w0 * local_density * (1.f - u_sq * (0.5f * c_sq_inv));
+        const float d_equ1 = w1 * local_density * (1.f + (u_x * c_sq_inv) + (u_x * u_x) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ2 = w1 * local_density * (1.f + (u_y * c_sq_inv) + (u_y * u_y) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ3 = w1 * local_density * (1.f + (-u_x * c_sq_inv) + (u_x * u_x) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ4 = w1 * local_density * (1.f + (-u_y * c_sq_inv) + (u_y * u_y) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ5 = w2 * local_density * (1.f + ((u_x + u_y) * c_sq_inv) + ((u_x + u_y) * (u_x + u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ6 = w2 * local_density * (1.f + ((-u_x + u_y) * c_sq_inv) + ((-u_x + u_y) * (-u_x + u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ7 = w2 * local_density * (1.f + ((-u_x - u_y) * c_sq_inv) + ((-u_x - u_y) * (-u_x - u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+        const float d_equ8 = w2 * local_density * (1.f + ((u_x - u_y) * c_sq_inv) + ((u_x - u_y) * (u_x - u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+
+        tmp_cells_speeds0[ii + jj * params.nx] = s0 + params.omega * (d_equ0 - s0);
+        tmp_cells_speeds1[ii + jj * params.nx] = s1 + params.omega * (d_equ1 - s1);
+        tmp_cells_speeds2[ii + jj * params.nx] = s2 + params.omega * (d_equ2 - s2);
+        tmp_cells_speeds3[ii + jj * params.nx] = s3 + params.omega * (d_equ3 - s3);
+        tmp_cells_speeds4[ii + jj * params.nx] = s4 + params.omega * (d_equ4 - s4);
+        tmp_cells_speeds5[ii + jj * params.nx] = s5 + params.omega * (d_equ5 - s5);
+        tmp_cells_speeds6[ii + jj * params.nx] = s6 + params.omega * (d_equ6 - s6);
+        tmp_cells_speeds7[ii + jj * params.nx] = s7 + params.omega * (d_equ7 - s7);
+        tmp_cells_speeds8[ii + jj * params.nx] = s8 + params.omega * (d_equ8 - s8);
+
+        /* accumulate the norm of x- and y- velocity components */
+        tot_u += sqrtf((u_x * u_x) + (u_y * u_y));
+        /* increase counter of inspected cells */
+        tot_cells += 1;
+      }
+    }
+  }
+
+  return tot_u / (float)tot_cells;
+}
+
+static float vectorised_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles)
+{
+  t_speed *cells = *cells_ptr;
+  t_speed *tmp_cells = *tmp_cells_ptr;
+
+  accelerate_flow_soa(params, cells, obstacles);
+  const float av_vel = vectorised_sweep(params,
+                                        cells->speeds0, cells->speeds1, cells->speeds2, cells->speeds3, cells->speeds4, cells->speeds5, cells->speeds6, cells->speeds7, cells->speeds8,
+                                        tmp_cells->speeds0, tmp_cells->speeds1, tmp_cells->speeds2, tmp_cells->speeds3, tmp_cells->speeds4, tmp_cells->speeds5, tmp_cells->speeds6, tmp_cells->speeds7, tmp_cells->speeds8,
+                                        obstacles);
+
+  *cells_ptr = tmp_cells;
+  *tmp_cells_ptr = cells;
+
+  return av_vel;
+}
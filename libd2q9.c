@@ -0,0 +1,280 @@
+/*
+** libd2q9: the C API of d2q9.h over the solver's own functions.
+**
+** The library is built from this file, kernels.c, sweeps.c, arena.c
+** and d2q9-bgk.c compiled with -DD2Q9_LIBRARY, which leaves out main()
+** and its option handling. The solver reports errors through die(), which exits; every
+** entry point that can reach it sets die_jump first, so die() returns
+** here instead and the message ends up in d2q9_error().
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <omp.h>
+
+#include "d2q9-bgk.h"
+#include "d2q9.h"
+
+struct d2q9_sim
+{
+  t_param params;
+  const t_kernel *kernel;
+  t_speed *cells;     /* current state */
+  t_speed *tmp_cells; /* scratch space */
+  int *obstacles;
+  void *grid;         /* cells and tmp_cells in the kernel's layout, while d2q9_step() runs */
+  void *tmp_grid;
+  float *fields;      /* density, u_x, u_y and pressure, nx * ny each, allocated by the first d2q9_get_fields() */
+  int steps;          /* no. of steps taken */
+  float av_vel;       /* average velocity after the last step */
+};
+
+static char last_error[sizeof(die_message)];
+
+/*
+** Run the statement with die() jumping back here, returning failure
+** from the calling function if it does. Jumps nest, in case the caller
+** is itself inside a die_jump region (e.g. the --serve job loop).
+*/
+#define D2Q9_GUARD(statement, failure)            \
+  do                                              \
+  {                                               \
+    jmp_buf jump;                                 \
+    jmp_buf *outer = die_jump;                    \
+    die_jump = &jump;                             \
+    if (setjmp(jump))                             \
+    {                                             \
+      die_jump = outer;                           \
+      strcpy(last_error, die_message);            \
+      return failure;                             \
+    }                                             \
+    statement;                                    \
+    die_jump = outer;                             \
+  } while (0)
+
+static int fail(const char *message)
+{
+  snprintf(last_error, sizeof(last_error), "%s", message);
+  return -1;
+}
+
+const char *d2q9_error(void)
+{
+  return last_error;
+}
+
+int d2q9_read_params(const char *paramfile, d2q9_params *params)
+{
+  t_param read;
+
+  D2Q9_GUARD(read_params(paramfile, &read), -1);
+
+  params->nx = read.nx;
+  params->ny = read.ny;
+  params->max_iters = read.maxIters;
+  params->reynolds_dim = read.reynolds_dim;
+  params->density = read.density;
+  params->accel = read.accel;
+  params->omega = read.omega;
+
+  return 0;
+}
+
+d2q9_sim *d2q9_create(const d2q9_params *params)
+{
+  if (params->nx < 3 || params->ny < 3)
+  {
+    fail("nx and ny must be at least 3");
+    return NULL;
+  }
+
+  d2q9_sim *sim = (d2q9_sim *)calloc(1, sizeof(d2q9_sim));
+
+  if (sim == NULL)
+  {
+    fail("cannot allocate memory for the simulation");
+    return NULL;
+  }
+
+  sim->params.nx = params->nx;
+  sim->params.ny = params->ny;
+  sim->params.maxIters = params->max_iters;
+  sim->params.reynolds_dim = params->reynolds_dim;
+  sim->params.density = params->density;
+  sim->params.accel = params->accel;
+  sim->params.omega = params->omega;
+  sim->kernel = &kernels[nkernels - 1];
+
+  D2Q9_GUARD(allocate_grids(&sim->params, &sim->cells, &sim->tmp_cells, &sim->obstacles), (free(sim), NULL));
+
+#ifdef PROFILE_PHASES
+  /* current_step() records its phases whatever the caller */
+  static int profiling = 0;
+
+  if (!profiling)
+  {
+    profile_init(omp_get_max_threads());
+    profiling = 1;
+  }
+#endif
+
+  return sim;
+}
+
+int d2q9_load_geometry(d2q9_sim *sim, const char *obstaclefile)
+{
+  D2Q9_GUARD(load_obstacles(obstaclefile, &sim->params, sim->obstacles), -1);
+
+  return 0;
+}
+
+int d2q9_set_geometry(d2q9_sim *sim, const unsigned char *mask)
+{
+  for (int ii = 0; ii < sim->params.nx * sim->params.ny; ii++)
+    sim->obstacles[ii] = mask[ii] != 0;
+
+  return 0;
+}
+
+int d2q9_set_kernel(d2q9_sim *sim, const char *name)
+{
+  const t_kernel *kernel = find_kernel(name);
+
+  if (kernel == NULL)
+    return fail("unknown kernel");
+
+  sim->kernel = kernel_for_grid(kernel, sim->params);
+
+  return 0;
+}
+
+/* the steps, in the kernel's layout; the grids live in sim so they survive a jump out of die() */
+static void step_grids(d2q9_sim *sim, int n, float *av_vels)
+{
+  for (int tt = 0; tt < n; tt++)
+  {
+    sim->av_vel = sim->kernel->step(sim->params, &sim->grid, &sim->tmp_grid, sim->obstacles);
+    sim->steps++;
+
+    if (av_vels)
+      av_vels[tt] = sim->av_vel;
+  }
+}
+
+/* back to cells and tmp_cells; returns -1, to be the failure of a D2Q9_GUARD */
+static int close_grids(d2q9_sim *sim)
+{
+  kernel_grids_close(sim->kernel, sim->params, &sim->cells, &sim->tmp_cells, sim->grid, sim->tmp_grid);
+  sim->grid = sim->tmp_grid = NULL;
+
+  return -1;
+}
+
+int d2q9_step(d2q9_sim *sim, int n, float *av_vels)
+{
+  if (n < 0)
+    return fail("the no. of steps must not be negative");
+
+  /* array of structs kernels convert in and out once per call, not per step */
+  D2Q9_GUARD(kernel_grids_open(sim->kernel, sim->params, sim->cells, sim->tmp_cells, sim->obstacles,
+                               &sim->grid, &sim->tmp_grid), -1);
+
+  /* a failed step still converts back, so the state is the last complete step's */
+  D2Q9_GUARD(step_grids(sim, n, av_vels), close_grids(sim));
+
+  close_grids(sim);
+
+  return 0;
+}
+
+int d2q9_get_fields(d2q9_sim *sim, d2q9_fields *fields)
+{
+  const int ncells = sim->params.nx * sim->params.ny;
+  const t_speed *cells = sim->cells;
+
+  if (sim->fields == NULL)
+  {
+    sim->fields = (float *)malloc(sizeof(float) * 4 * ncells);
+
+    if (sim->fields == NULL)
+      return fail("cannot allocate memory for the macroscopic fields");
+  }
+
+  float *density = sim->fields;
+  float *u_x = sim->fields + ncells;
+  float *u_y = sim->fields + 2 * ncells;
+  float *pressure = sim->fields + 3 * ncells;
+  const float blocked_pressure = sim->params.density * c_sq;
+
+#pragma omp parallel for
+  for (int ii = 0; ii < ncells; ii++)
+  {
+    if (sim->obstacles[ii])
+    {
+      density[ii] = u_x[ii] = u_y[ii] = 0.f;
+      pressure[ii] = blocked_pressure;
+      continue;
+    }
+
+    const float local_density = cells->speeds0[ii] + cells->speeds1[ii] + cells->speeds2[ii] +
+                                cells->speeds3[ii] + cells->speeds4[ii] + cells->speeds5[ii] +
+                                cells->speeds6[ii] + cells->speeds7[ii] + cells->speeds8[ii];
+
+    density[ii] = local_density;
+    u_x[ii] = (cells->speeds1[ii] + cells->speeds5[ii] + cells->speeds8[ii] -
+               (cells->speeds3[ii] + cells->speeds6[ii] + cells->speeds7[ii])) / local_density;
+    u_y[ii] = (cells->speeds2[ii] + cells->speeds5[ii] + cells->speeds6[ii] -
+               (cells->speeds4[ii] + cells->speeds7[ii] + cells->speeds8[ii])) / local_density;
+    pressure[ii] = local_density * c_sq;
+  }
+
+  fields->nx = sim->params.nx;
+  fields->ny = sim->params.ny;
+  fields->speeds[0] = cells->speeds0;
+  fields->speeds[1] = cells->speeds1;
+  fields->speeds[2] = cells->speeds2;
+  fields->speeds[3] = cells->speeds3;
+  fields->speeds[4] = cells->speeds4;
+  fields->speeds[5] = cells->speeds5;
+  fields->speeds[6] = cells->speeds6;
+  fields->speeds[7] = cells->speeds7;
+  fields->speeds[8] = cells->speeds8;
+  fields->obstacles = sim->obstacles;
+  fields->density = density;
+  fields->u_x = u_x;
+  fields->u_y = u_y;
+  fields->pressure = pressure;
+
+  return 0;
+}
+
+int d2q9_steps(const d2q9_sim *sim)
+{
+  return sim->steps;
+}
+
+float d2q9_av_velocity(const d2q9_sim *sim)
+{
+  return sim->av_vel;
+}
+
+float d2q9_reynolds(const d2q9_sim *sim)
+{
+  return calc_reynolds(sim->params, sim->cells, sim->obstacles);
+}
+
+void d2q9_destroy(d2q9_sim *sim)
+{
+  float *av_vels = NULL;
+
+  if (sim == NULL)
+    return;
+
+  finalise(&sim->params, &sim->cells, &sim->tmp_cells, &sim->obstacles, &av_vels);
+  free(sim->fields);
+  free(sim);
+}
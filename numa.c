@@ -0,0 +1,322 @@
+/*
+** NUMA placement: topology detection, thread pinning and a report of
+** where the lattice actually ended up.
+**
+** The nodes and their CPUs come from /sys/devices/system/node (no
+** libnuma needed), restricted to the CPUs the process may run on.
+** numa_pin_threads() gives OpenMP thread t of n the node t * nnodes / n,
+** so with the static row partition each node sweeps one contiguous band
+** of rows, and pins it to a CPU of that node, one thread per core before
+** any second hyperthread. reset_grids() first touches the lattice with
+** the same partition, which puts every row on the node sweeping it.
+**
+** Pinning is skipped when OMP_PROC_BIND, OMP_PLACES, GOMP_CPU_AFFINITY
+** or KMP_AFFINITY already ask the OpenMP runtime to place the threads,
+** and with --no-pin.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <omp.h>
+
+#include "d2q9-bgk.h"
+
+#define NUMA_MAX_CPUS 4096
+#define NUMA_MAX_NODES 64
+
+/* struct to hold the topology, as far as this process can use it */
+typedef struct
+{
+  int detected;
+  int nnodes;                       /* nodes with at least one usable CPU */
+  int node_id[NUMA_MAX_NODES];      /* sysfs no. of each node */
+  int first[NUMA_MAX_NODES + 1];    /* node nn's CPUs are cpus[first[nn]] to cpus[first[nn + 1] - 1] */
+  int cpus[NUMA_MAX_CPUS];          /* usable CPUs, by node, first hyperthreads first */
+  int cpu_node[NUMA_MAX_CPUS];      /* node index of each CPU no., -1 if unusable */
+  int pinned;                       /* no. of threads numa_pin_threads() pinned, 0 if it did not */
+} t_numa;
+
+static t_numa numa;
+
+/* parse a sysfs CPU list such as "0-13,28-41" into a mask */
+static void parse_cpulist(const char *list, cpu_set_t *set)
+{
+  CPU_ZERO(set);
+
+  while (*list != '\0' && *list != '\n')
+  {
+    char *end;
+    const long lo = strtol(list, &end, 10);
+    long hi = lo;
+
+    if (end == list)
+      return;
+
+    if (*end == '-')
+      hi = strtol(end + 1, &end, 10);
+
+    for (long cpu = lo; cpu <= hi && cpu < NUMA_MAX_CPUS; cpu++)
+      CPU_SET(cpu, set);
+
+    list = (*end == ',') ? end + 1 : end;
+  }
+}
+
+static int read_cpulist(const char *path, cpu_set_t *set)
+{
+  char line[4096];
+  FILE *fp = fopen(path, "r");
+
+  if (fp == NULL)
+    return 0;
+
+  const int ok = fgets(line, sizeof(line), fp) != NULL;
+  fclose(fp);
+
+  if (ok)
+    parse_cpulist(line, set);
+
+  return ok;
+}
+
+/* whether cpu is the first hyperthread of its core */
+static int first_sibling(int cpu)
+{
+  char path[128];
+  cpu_set_t siblings;
+
+  sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+
+  if (!read_cpulist(path, &siblings))
+    return 1;
+
+  for (int other = 0; other < cpu; other++)
+  {
+    if (CPU_ISSET(other, &siblings))
+      return 0;
+  }
+
+  return 1;
+}
+
+/* add the allowed CPUs of set as the next node, first hyperthreads first */
+static void add_node(int id, const cpu_set_t *set, const cpu_set_t *allowed)
+{
+  const int start = numa.first[numa.nnodes];
+  int count = start;
+
+  for (int pass = 0; pass < 2; pass++)
+  {
+    for (int cpu = 0; cpu < NUMA_MAX_CPUS; cpu++)
+    {
+      if (CPU_ISSET(cpu, set) && CPU_ISSET(cpu, allowed) && first_sibling(cpu) == (pass == 0))
+      {
+        numa.cpus[count++] = cpu;
+        numa.cpu_node[cpu] = numa.nnodes;
+      }
+    }
+  }
+
+  if (count > start)
+  {
+    numa.node_id[numa.nnodes] = id;
+    numa.nnodes++;
+    numa.first[numa.nnodes] = count;
+  }
+}
+
+static void numa_detect(void)
+{
+  cpu_set_t allowed;
+  DIR *dir;
+  struct dirent *entry;
+
+  if (numa.detected)
+    return;
+
+  numa.detected = 1;
+
+  for (int cpu = 0; cpu < NUMA_MAX_CPUS; cpu++)
+    numa.cpu_node[cpu] = -1;
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+  {
+    CPU_ZERO(&allowed);
+
+    for (int cpu = 0; cpu < NUMA_MAX_CPUS; cpu++)
+      CPU_SET(cpu, &allowed);
+  }
+
+  /* nodes in numerical order, which readdir does not promise */
+  dir = opendir("/sys/devices/system/node");
+
+  if (dir != NULL)
+  {
+    int present[NUMA_MAX_NODES] = {0};
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+      int id;
+
+      if (sscanf(entry->d_name, "node%d", &id) == 1 && id >= 0 && id < NUMA_MAX_NODES)
+        present[id] = 1;
+    }
+
+    closedir(dir);
+
+    for (int id = 0; id < NUMA_MAX_NODES; id++)
+    {
+      char path[128];
+      cpu_set_t set;
+
+      sprintf(path, "/sys/devices/system/node/node%d/cpulist", id);
+
+      if (present[id] && read_cpulist(path, &set))
+        add_node(id, &set, &allowed);
+    }
+  }
+
+  /* no sysfs: one node of all the allowed CPUs */
+  if (numa.nnodes == 0)
+    add_node(0, &allowed, &allowed);
+}
+
+static int runtime_binds(void)
+{
+  return getenv("OMP_PROC_BIND") != NULL || getenv("OMP_PLACES") != NULL || getenv("GOMP_CPU_AFFINITY") != NULL ||
+         getenv("KMP_AFFINITY") != NULL;
+}
+
+void numa_pin_threads(void)
+{
+  numa_detect();
+  numa.pinned = 0;
+
+  if (runtime_binds() || numa.nnodes == 0)
+    return;
+
+  int pinned = 0;
+
+#pragma omp parallel reduction(+ : pinned)
+  {
+    const int thread = omp_get_thread_num();
+    const int nthreads = omp_get_num_threads();
+    const int node = (int)((long)thread * numa.nnodes / nthreads);
+    /* this thread's place among the threads of its node */
+    const int first_thread = (int)(((long)node * nthreads + numa.nnodes - 1) / numa.nnodes);
+    const int ncpus = numa.first[node + 1] - numa.first[node];
+    const int cpu = numa.cpus[numa.first[node] + (thread - first_thread) % ncpus];
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pinned += sched_setaffinity(0, sizeof(set), &set) == 0;
+  }
+
+  numa.pinned = pinned;
+}
+
+/*
+** Count the rows of the 18 speed arrays and the obstacles that are on
+** the node of the thread sweeping them, given the node index of each
+** row's thread. The page of each row comes from move_pages(2), which
+** only reports where pages are when given no target nodes. Returns 0,
+** or -1 if the pages cannot be queried.
+*/
+static int count_local_rows(const t_param params, const t_speed *cells, const t_speed *tmp_cells,
+                            const int *obstacles, const int *row_node, long *local, long *remote)
+{
+#ifdef SYS_move_pages
+  const int narrays = 2 * NSPEEDS + 1;
+  const void *arrays[] = {cells->speeds0, cells->speeds1, cells->speeds2, cells->speeds3, cells->speeds4,
+                          cells->speeds5, cells->speeds6, cells->speeds7, cells->speeds8,
+                          tmp_cells->speeds0, tmp_cells->speeds1, tmp_cells->speeds2, tmp_cells->speeds3,
+                          tmp_cells->speeds4, tmp_cells->speeds5, tmp_cells->speeds6, tmp_cells->speeds7,
+                          tmp_cells->speeds8, obstacles};
+  const long count = (long)narrays * params.ny;
+  const size_t row_bytes = sizeof(float) * params.nx; /* ints are the same size */
+  void **pages = (void **)malloc(sizeof(void *) * count);
+  int *status = (int *)malloc(sizeof(int) * count);
+  int result = -1;
+
+  if (pages == NULL || status == NULL)
+    die("cannot allocate memory for the NUMA report", __LINE__, __FILE__);
+
+  for (int aa = 0; aa < narrays; aa++)
+  {
+    for (int jj = 0; jj < params.ny; jj++)
+      pages[(long)aa * params.ny + jj] = (void *)((const char *)arrays[aa] + jj * row_bytes);
+  }
+
+  if (syscall(SYS_move_pages, 0, count, pages, NULL, status, 0) == 0)
+  {
+    *local = *remote = 0;
+
+    for (long pp = 0; pp < count; pp++)
+    {
+      const int jj = (int)(pp % params.ny);
+
+      if (status[pp] < 0 || row_node[jj] < 0)
+        continue;
+
+      if (status[pp] == numa.node_id[row_node[jj]])
+        (*local)++;
+      else
+        (*remote)++;
+    }
+
+    result = 0;
+  }
+
+  free(pages);
+  free(status);
+
+  return result;
+#else
+  (void)params, (void)cells, (void)tmp_cells, (void)obstacles, (void)row_node, (void)local, (void)remote;
+  return -1;
+#endif
+}
+
+void numa_report(const t_param params, const t_speed *cells, const t_speed *tmp_cells, const int *obstacles)
+{
+  numa_detect();
+
+  const int nthreads = omp_get_max_threads();
+  const char *placed = numa.pinned ? "pinned" : "placed by the OpenMP runtime";
+  int *row_node = (int *)malloc(sizeof(int) * params.ny);
+  int *thread_node = (int *)malloc(sizeof(int) * nthreads);
+  long local, remote;
+
+  if (row_node == NULL || thread_node == NULL)
+    die("cannot allocate memory for the NUMA report", __LINE__, __FILE__);
+
+#pragma omp parallel
+  {
+    const int cpu = sched_getcpu();
+    thread_node[omp_get_thread_num()] = (cpu >= 0 && cpu < NUMA_MAX_CPUS) ? numa.cpu_node[cpu] : -1;
+  }
+
+  /* the rows each thread gets under the sweep's schedule */
+#pragma omp parallel for schedule(runtime)
+  for (int jj = 0; jj < params.ny; jj++)
+    row_node[jj] = thread_node[omp_get_thread_num()];
+
+  printf("NUMA placement:\t\t\t\t%d node%s, %d thread%s %s, ", numa.nnodes, numa.nnodes == 1 ? "" : "s", nthreads,
+         nthreads == 1 ? "" : "s", placed);
+
+  if (count_local_rows(params, cells, tmp_cells, obstacles, row_node, &local, &remote) == 0 && local + remote > 0)
+    printf("%.1lf%% of lattice rows on their thread's node (%ld remote)\n", 100.0 * local / (local + remote), remote);
+  else
+    printf("page locations unavailable\n");
+
+  free(row_node);
+  free(thread_node);
+}
@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+"""Python bindings for libd2q9 (see d2q9.h), using ctypes and numpy.
+
+Build the shared library first with ``make lib``. The lattice arrays are
+numpy views of the solver's own memory, so reading them costs nothing:
+
+    import d2q9
+
+    sim = d2q9.Simulation("input_1024x1024.params", "obstacles_1024x1024.dat")
+    for _ in range(100):
+        av_vels = sim.step(200)
+        state = sim.state()
+        print(sim.steps, av_vels[-1], state.u_x.max())
+
+Arrays are shaped (ny, nx), so ``state.u_x[jj, ii]`` is cell (ii, jj) of
+final_state.dat. They are only valid until the next ``step()`` or
+``state()``: the solver swaps its two grids every step and reuses the
+field buffers, so copy anything that has to outlive that.
+
+The library is found through the D2Q9_LIB environment variable, or as
+libd2q9.so in the repository root, or on the normal library path.
+"""
+
+import ctypes
+import os
+
+import numpy as np
+
+NSPEEDS = 9
+
+
+class _Params(ctypes.Structure):
+    _fields_ = [
+        ("nx", ctypes.c_int),
+        ("ny", ctypes.c_int),
+        ("max_iters", ctypes.c_int),
+        ("reynolds_dim", ctypes.c_int),
+        ("density", ctypes.c_float),
+        ("accel", ctypes.c_float),
+        ("omega", ctypes.c_float),
+    ]
+
+
+class _Fields(ctypes.Structure):
+    _fields_ = [
+        ("nx", ctypes.c_int),
+        ("ny", ctypes.c_int),
+        ("speeds", ctypes.POINTER(ctypes.c_float) * NSPEEDS),
+        ("obstacles", ctypes.POINTER(ctypes.c_int)),
+        ("density", ctypes.POINTER(ctypes.c_float)),
+        ("u_x", ctypes.POINTER(ctypes.c_float)),
+        ("u_y", ctypes.POINTER(ctypes.c_float)),
+        ("pressure", ctypes.POINTER(ctypes.c_float)),
+    ]
+
+
+class Error(Exception):
+    """A libd2q9 call failed."""
+
+
+def _load_library():
+    path = os.environ.get("D2Q9_LIB")
+
+    if path is None:
+        local = os.path.join(os.path.dirname(os.path.abspath(__file__)), os.pardir, "libd2q9.so")
+        path = local if os.path.exists(local) else "libd2q9.so"
+
+    lib = ctypes.CDLL(path)
+    sim = ctypes.c_void_p
+    float_p = ctypes.POINTER(ctypes.c_float)
+
+    for name, restype, argtypes in [
+        ("d2q9_read_params", ctypes.c_int, [ctypes.c_char_p, ctypes.POINTER(_Params)]),
+        ("d2q9_create", sim, [ctypes.POINTER(_Params)]),
+        ("d2q9_load_geometry", ctypes.c_int, [sim, ctypes.c_char_p]),
+        ("d2q9_set_geometry", ctypes.c_int, [sim, ctypes.POINTER(ctypes.c_ubyte)]),
+        ("d2q9_set_kernel", ctypes.c_int, [sim, ctypes.c_char_p]),
+        ("d2q9_step", ctypes.c_int, [sim, ctypes.c_int, float_p]),
+        ("d2q9_get_fields", ctypes.c_int, [sim, ctypes.POINTER(_Fields)]),
+        ("d2q9_steps", ctypes.c_int, [sim]),
+        ("d2q9_av_velocity", ctypes.c_float, [sim]),
+        ("d2q9_reynolds", ctypes.c_float, [sim]),
+        ("d2q9_destroy", None, [sim]),
+        ("d2q9_error", ctypes.c_char_p, []),
+    ]:
+        function = getattr(lib, name)
+        function.restype = restype
+        function.argtypes = argtypes
+
+    return lib
+
+
+_lib = None
+
+
+def _library():
+    global _lib
+
+    if _lib is None:
+        _lib = _load_library()
+
+    return _lib
+
+
+def _check(result):
+    if result != 0:
+        raise Error(_library().d2q9_error().decode())
+
+
+class State:
+    """Zero-copy (ny, nx) views of the lattice at one point of the run."""
+
+    def __init__(self, fields):
+        shape = (fields.ny, fields.nx)
+
+        def view(pointer):
+            return np.ctypeslib.as_array(pointer, shape=shape)
+
+        self.speeds = [view(fields.speeds[kk]) for kk in range(NSPEEDS)]
+        self.obstacles = view(fields.obstacles)
+        self.density = view(fields.density)
+        self.u_x = view(fields.u_x)
+        self.u_y = view(fields.u_y)
+        self.pressure = view(fields.pressure)
+
+    @property
+    def u(self):
+        """Norm of the velocity (a new array, not a view)."""
+        return np.hypot(self.u_x, self.u_y)
+
+
+class Simulation:
+    """One lattice, stepped in-process by libd2q9."""
+
+    def __init__(self, paramfile, obstaclefile=None, kernel=None):
+        # first, so close() and __del__ work however far the constructor gets
+        self._sim = None
+        lib = _library()
+        self.params = _Params()
+        _check(lib.d2q9_read_params(paramfile.encode(), ctypes.byref(self.params)))
+        self._sim = lib.d2q9_create(ctypes.byref(self.params))
+
+        if not self._sim:
+            raise Error(lib.d2q9_error().decode())
+
+        if obstaclefile is not None:
+            _check(lib.d2q9_load_geometry(self._sim, obstaclefile.encode()))
+
+        if kernel is not None:
+            _check(lib.d2q9_set_kernel(self._sim, kernel.encode()))
+
+    @property
+    def nx(self):
+        return self.params.nx
+
+    @property
+    def ny(self):
+        return self.params.ny
+
+    def set_geometry(self, mask):
+        """Replace the obstacles with a (ny, nx) array, nonzero where blocked."""
+        mask = np.ascontiguousarray(mask, dtype=np.uint8)
+
+        if mask.shape != (self.ny, self.nx):
+            raise ValueError("mask must be shaped (ny, nx) = (%d, %d)" % (self.ny, self.nx))
+
+        _check(_library().d2q9_set_geometry(self._sim, mask.ctypes.data_as(ctypes.POINTER(ctypes.c_ubyte))))
+
+    def step(self, n=1):
+        """Advance n steps, returning the average velocity after each."""
+        av_vels = np.empty(n, dtype=np.float32)
+        _check(_library().d2q9_step(self._sim, n, av_vels.ctypes.data_as(ctypes.POINTER(ctypes.c_float))))
+
+        return av_vels
+
+    def state(self):
+        """Views of the speeds, obstacles and macroscopic fields, valid until the next step() or state()."""
+        fields = _Fields()
+        _check(_library().d2q9_get_fields(self._sim, ctypes.byref(fields)))
+
+        return State(fields)
+
+    @property
+    def steps(self):
+        return _library().d2q9_steps(self._sim)
+
+    @property
+    def av_velocity(self):
+        return _library().d2q9_av_velocity(self._sim)
+
+    @property
+    def reynolds(self):
+        return _library().d2q9_reynolds(self._sim)
+
+    def close(self):
+        if self._sim:
+            _library().d2q9_destroy(self._sim)
+            self._sim = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
@@ -0,0 +1,362 @@
+/*
+** Solver daemon and its client.
+**
+** For thousands of small jobs, process start-up, allocating the
+** lattices and page-faulting them in are a large share of each run.
+**
+**   ./d2q9-bgk --serve=/tmp/d2q9.sock [--kernel=NAME]
+**
+** stays resident with the OpenMP thread pool started and the lattices
+** of the largest job so far allocated and faulted in, and runs one job
+** at a time as they arrive on the Unix socket. The client
+**
+**   ./d2q9-bgk --submit=/tmp/d2q9.sock input.params obstacles.dat [outdir]
+**
+** sends a job, prints what comes back and exits nonzero if the job
+** failed; ./d2q9-bgk --submit=SOCKET quit stops the server.
+**
+** The protocol is one request line per connection, fields separated by
+** spaces (so paths cannot contain any), relative paths being relative
+** to the server's working directory:
+**
+**   run <paramfile> <obstaclefile> <outdir>
+**   quit
+**
+** answered by lines of:
+**
+**   accepted <nx>x<ny> <maxIters>
+**   progress <step> <maxIters> <av_vel>     (about SERVE_PROGRESS times a job)
+**   result {"kernel": ..., "compute_s": ..., "mlups": ..., ...}
+**   done <outdir>
+**
+** or an "error <message>" line in place of whatever did not happen.
+** final_state.dat and av_vels.dat are written to outdir, which is
+** created if need be. A job that fails (e.g. a missing input file) is
+** reported to its client and the server carries on: die() longjmp()s
+** back to the job loop while a job runs (leaking the input file it was
+** reading, if any).
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "d2q9-bgk.h"
+
+#define SERVE_LINE_LEN (3 * PATH_MAX + 16)
+#define SERVE_PROGRESS 20 /* progress lines per job */
+#define SERVE_BACKLOG 16
+
+/* struct to hold the buffers the server keeps between jobs */
+typedef struct
+{
+  const t_kernel *kernel; /* kernel variant stepping every job */
+  int cwd;                /* fd of the working directory, to return to after writing a job's output */
+  int capacity;           /* no. of cells the grids have room for */
+  int av_capacity;        /* no. of steps av_vels has room for */
+  t_param allocated;      /* params the grids were allocated for */
+  t_speed *cells;
+  t_speed *tmp_cells;
+  int *obstacles;
+  float *av_vels;
+} t_server;
+
+/* make sure the grids have room for params, then reset them */
+static void server_grids(t_server *server, const t_param *params)
+{
+  const int ncells = params->nx * params->ny;
+
+  if (ncells > server->capacity)
+  {
+    /* allocate_grids() faults every page in, once per size increase */
+    if (server->capacity)
+      finalise(&server->allocated, &server->cells, &server->tmp_cells, &server->obstacles, &server->av_vels);
+
+    server->av_capacity = 0;
+    server->allocated = *params;
+    allocate_grids(params, &server->cells, &server->tmp_cells, &server->obstacles);
+    server->capacity = ncells;
+  }
+  else
+    reset_grids(params, server->cells, server->tmp_cells, server->obstacles);
+
+  if (params->maxIters > server->av_capacity)
+  {
+    float *av_vels = (float *)realloc(server->av_vels, sizeof(float) * params->maxIters);
+
+    if (av_vels == NULL)
+      die("cannot allocate memory for av_vels", __LINE__, __FILE__);
+
+    server->av_vels = av_vels;
+    server->av_capacity = params->maxIters;
+  }
+}
+
+static void serve_job(t_server *server, FILE *out, const char *paramfile, const char *obstaclefile,
+                      const char *outdir)
+{
+  t_param params;
+  void *grid = NULL;
+  void *tmp_grid = NULL;
+  jmp_buf jump;
+
+  die_jump = &jump;
+
+  if (setjmp(jump))
+  {
+    fprintf(out, "error %s\n", die_message);
+    fflush(out);
+
+    if (fchdir(server->cwd) != 0)
+      fprintf(stderr, "warning: could not return to the server's working directory\n");
+
+    die_jump = NULL;
+    return;
+  }
+
+  read_params(paramfile, &params);
+
+  if (params.nx < 3 || params.ny < 3 || params.maxIters < 1)
+    die("nx and ny must be at least 3 and maxIters positive", __LINE__, __FILE__);
+
+  const t_kernel *kernel = kernel_for_grid(server->kernel, params);
+
+  server_grids(server, &params);
+  load_obstacles(obstaclefile, &params, server->obstacles);
+
+  fprintf(out, "accepted %dx%d %d\n", params.nx, params.ny, params.maxIters);
+  fflush(out);
+
+  const int every = params.maxIters > SERVE_PROGRESS ? params.maxIters / SERVE_PROGRESS : 1;
+  const double tic = monotonic_clock();
+
+  kernel_grids_open(kernel, params, server->cells, server->tmp_cells, server->obstacles, &grid, &tmp_grid);
+
+  for (int tt = 0; tt < params.maxIters; tt++)
+  {
+    server->av_vels[tt] = kernel->step(params, &grid, &tmp_grid, server->obstacles);
+
+    if ((tt + 1) % every == 0)
+    {
+      fprintf(out, "progress %d %d %.12E\n", tt + 1, params.maxIters, server->av_vels[tt]);
+      fflush(out);
+    }
+  }
+
+  kernel_grids_close(kernel, params, &server->cells, &server->tmp_cells, grid, tmp_grid);
+
+  const double compute = monotonic_clock() - tic;
+  const float reynolds = calc_reynolds(params, server->cells, server->obstacles);
+
+  if (mkdir(outdir, 0777) != 0 && errno != EEXIST)
+    die("could not create the output directory", __LINE__, __FILE__);
+
+  if (chdir(outdir) != 0)
+    die("could not change to the output directory", __LINE__, __FILE__);
+
+  write_values(params, server->cells, server->obstacles, server->av_vels, params.maxIters);
+
+  if (fchdir(server->cwd) != 0)
+    die("could not return to the server's working directory", __LINE__, __FILE__);
+
+  fprintf(out, "result {\"kernel\": \"%s\", \"nx\": %d, \"ny\": %d, \"iters\": %d, \"threads\": %d, "
+               "\"reynolds\": %.12E, \"compute_s\": %.6lf, \"mlups\": %.3lf}\n",
+          kernel->name, params.nx, params.ny, params.maxIters, omp_get_max_threads(),
+          reynolds, compute, (double)params.nx * params.ny * params.maxIters / compute / 1.0e6);
+  fprintf(out, "done %s\n", outdir);
+  fflush(out);
+
+  die_jump = NULL;
+}
+
+/* the socket path, checked for length */
+static void socket_address(const char *path, struct sockaddr_un *addr)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+
+  if (strlen(path) >= sizeof(addr->sun_path))
+    die("socket path too long", __LINE__, __FILE__);
+
+  strcpy(addr->sun_path, path);
+}
+
+int serve(int argc, char *argv[])
+{
+  const char *path = argv[1] + 8;
+  struct sockaddr_un addr;
+  t_server server;
+  char line[SERVE_LINE_LEN];
+
+  memset(&server, 0, sizeof(server));
+  server.kernel = &kernels[nkernels - 1];
+
+  for (int aa = 2; aa < argc; aa++)
+  {
+    if (strncmp(argv[aa], "--kernel=", 9) == 0 && find_kernel(argv[aa] + 9))
+      server.kernel = find_kernel(argv[aa] + 9);
+    else
+      die("usage: --serve=SOCKET [--kernel=NAME]", __LINE__, __FILE__);
+  }
+
+  server.cwd = open(".", O_RDONLY | O_DIRECTORY);
+
+  if (server.cwd < 0)
+    die("could not open the working directory", __LINE__, __FILE__);
+
+  /* a client hanging up mid-job must not take the server with it */
+  signal(SIGPIPE, SIG_IGN);
+
+  socket_address(path, &addr);
+  const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (listener < 0)
+    die("could not create socket", __LINE__, __FILE__);
+
+  unlink(path);
+
+  if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, SERVE_BACKLOG) != 0)
+    die("could not listen on socket", __LINE__, __FILE__);
+
+  /* start the thread pool now rather than in the first job */
+#pragma omp parallel
+  {
+  }
+
+#ifdef PROFILE_PHASES
+  /* current_step() records its phases whatever the caller */
+  profile_init(omp_get_max_threads());
+#endif
+
+  printf("Serving on %s: kernel %s, %d threads\n", path, server.kernel->name, omp_get_max_threads());
+  fflush(stdout);
+
+  int running = 1;
+
+  while (running)
+  {
+    const int fd = accept(listener, NULL, NULL);
+
+    if (fd < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      die("could not accept connection", __LINE__, __FILE__);
+    }
+
+    FILE *in = fdopen(fd, "r");
+    FILE *out = fdopen(dup(fd), "w");
+
+    if (in == NULL || out == NULL)
+      die("could not open connection streams", __LINE__, __FILE__);
+
+    if (fgets(line, sizeof(line), in))
+    {
+      char *save = NULL;
+      const char *command = strtok_r(line, " \t\r\n", &save);
+      const char *paramfile = strtok_r(NULL, " \t\r\n", &save);
+      const char *obstaclefile = strtok_r(NULL, " \t\r\n", &save);
+      const char *outdir = strtok_r(NULL, " \t\r\n", &save);
+
+      if (command && strcmp(command, "quit") == 0)
+      {
+        fprintf(out, "done quit\n");
+        running = 0;
+      }
+      else if (command && strcmp(command, "run") == 0 && outdir != NULL)
+      {
+        printf("Job: %s %s -> %s\n", paramfile, obstaclefile, outdir);
+        fflush(stdout);
+        serve_job(&server, out, paramfile, obstaclefile, outdir);
+      }
+      else
+        fprintf(out, "error expected \"run <paramfile> <obstaclefile> <outdir>\" or \"quit\"\n");
+    }
+
+    fclose(in);
+    fclose(out);
+  }
+
+#ifdef PROFILE_PHASES
+  profile_free();
+#endif
+
+  close(listener);
+  unlink(path);
+  close(server.cwd);
+
+  if (server.capacity)
+    finalise(&server.allocated, &server.cells, &server.tmp_cells, &server.obstacles, &server.av_vels);
+
+  return EXIT_SUCCESS;
+}
+
+int submit(int argc, char *argv[])
+{
+  const char *path = argv[1] + 9;
+  struct sockaddr_un addr;
+  char line[SERVE_LINE_LEN];
+  char paramfile[PATH_MAX];
+  char obstaclefile[PATH_MAX];
+  char outdir[PATH_MAX];
+
+  if (argc == 3 && strcmp(argv[2], "quit") == 0)
+    strcpy(line, "quit\n");
+  else if (argc == 4 || argc == 5)
+  {
+    const char *dir = argc == 5 ? argv[4] : ".";
+
+    /* the server has its own working directory */
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+      die("could not create the output directory", __LINE__, __FILE__);
+
+    if (realpath(argv[2], paramfile) == NULL || realpath(argv[3], obstaclefile) == NULL ||
+        realpath(dir, outdir) == NULL)
+      die("could not resolve the input files or output directory", __LINE__, __FILE__);
+
+    if (strpbrk(paramfile, " \t\r\n") || strpbrk(obstaclefile, " \t\r\n") || strpbrk(outdir, " \t\r\n"))
+      die("paths sent to the server cannot contain whitespace", __LINE__, __FILE__);
+
+    snprintf(line, sizeof(line), "run %s %s %s\n", paramfile, obstaclefile, outdir);
+  }
+  else
+    die("usage: --submit=SOCKET <paramfile> <obstaclefile> [outdir], or --submit=SOCKET quit", __LINE__, __FILE__);
+
+  socket_address(path, &addr);
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    die("could not connect to the server", __LINE__, __FILE__);
+
+  if (write(fd, line, strlen(line)) != (ssize_t)strlen(line))
+    die("could not send the job", __LINE__, __FILE__);
+
+  FILE *in = fdopen(fd, "r");
+  int status = EXIT_FAILURE;
+
+  while (fgets(line, sizeof(line), in))
+  {
+    fputs(line, stdout);
+    fflush(stdout);
+
+    if (strncmp(line, "done", 4) == 0)
+      status = EXIT_SUCCESS;
+  }
+
+  fclose(in);
+
+  return status;
+}
@@ -0,0 +1,549 @@
+/*
+** Policy-based sweep template.
+**
+** Every kernel variant in kernels.c is a hand-written copy of the whole
+** fused sweep, so trying a different storage layout, collision operator
+** or boundary treatment has meant forking it again. This header
+** generates the step function instead, from three compile-time
+** policies. sweeps.c includes it once per combination:
+**
+**   #define SWEEP_NAME sweep_soa_step
+**   #define SWEEP_LAYOUT SWEEP_SOA
+**   #define SWEEP_COLLISION SWEEP_BGK
+**   #define SWEEP_BOUNDARY SWEEP_WRAP
+**   #include "sweep.h"
+**
+** SWEEP_NAME       the step function to define, with the t_kernel signature
+** SWEEP_LAYOUT     SWEEP_SOA (a t_speed), SWEEP_AOS (an array of t_speed_aos),
+**                  SWEEP_AOSOA (an array of t_speed_aosoa) or SWEEP_PADDED
+**                  (a t_speed with rows PADDED_PITCH(nx) floats apart)
+** SWEEP_COLLISION  SWEEP_BGK, or SWEEP_TRT: two relaxation times, omega for
+**                  the even part of each pair of opposite populations and
+**                  the rate giving the magic parameter 1/4 for the odd part
+** SWEEP_BOUNDARY   SWEEP_WRAP, the periodic neighbours worked out for every
+**                  cell as in timestep(), or SWEEP_PEELED, the first and
+**                  last columns done apart so the inner loop has no wrap
+**
+** and optionally SWEEP_NX and SWEEP_NY, to compile the sweep for that
+** grid size only: the strides, trip counts and wrapped neighbours are
+** then constants. The caller must not step any other size with it.
+**
+** Also optional, SWEEP_STORE is SWEEP_CACHED (the default) or
+** SWEEP_STREAMING, for SWEEP_SOA or SWEEP_PADDED with SWEEP_PEELED only.
+** A streaming sweep collides SWEEP_STREAM_BLOCK cells of a row at a time
+** into a buffer that stays in L1, then copies the block to the new grid
+** with non-temporal stores, which write whole lines to memory without
+** first reading them in for ownership and without evicting the source
+** grid. Each thread fences its stores before the grids are swapped.
+**
+** Defining SWEEP_TILES (with SWEEP_PEELED, cached) sweeps each row as
+** runs of the tiles of the tile activity map (d2q9-bgk.h): solid tiles
+** are skipped, fluid ones collided with no obstacle test, and only mixed
+** ones check each cell. The map must have been built for the obstacles.
+**
+** Every instantiation records the phase timings and trace spans of
+** d2q9-bgk.h, as current_step() does.
+**
+** Obstacle cells bounce back in every combination. The policies are
+** macros and static inline functions, so each instantiation compiles to
+** the same flat, vectorised loop a hand-written variant would; the
+** SWEEP_ macros are undefined again at the end.
+*/
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#define SWEEP_SOA 1
+#define SWEEP_AOS 2
+#define SWEEP_AOSOA 3
+#define SWEEP_PADDED 4
+
+#define SWEEP_BGK 1
+#define SWEEP_TRT 2
+
+#define SWEEP_WRAP 1
+#define SWEEP_PEELED 2
+
+#define SWEEP_CACHED 1
+#define SWEEP_STREAMING 2
+
+#ifndef SWEEP_STREAM_BLOCK
+#define SWEEP_STREAM_BLOCK 256 /* cells per block, 9 KiB of buffer */
+#endif
+
+#define SWEEP_CAT_(a, b) a##_##b
+#define SWEEP_CAT(a, b) SWEEP_CAT_(a, b)
+
+#define SWEEP_TRT_MAGIC 0.25f /* (1 / omega_plus - 1/2) (1 / omega_minus - 1/2) */
+
+/* equilibrium densities of the cell, as in timestep() */
+static inline void sweep_equilibrium(const float local_density, const float u_x, const float u_y, float d_equ[NSPEEDS])
+{
+  const float u_sq = u_x * u_x + u_y * u_y;
+
+  d_equ[0] = w0 * local_density * (1.f - u_sq * (0.5f * c_sq_inv));
+  d_equ[1] = w1 * local_density * (1.f + (u_x * c_sq_inv) + (u_x * u_x) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+  d_equ[2] = w1 * local_density * (1.f + (u_y * c_sq_inv) + (u_y * u_y) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+  d_equ[3] = w1 * local_density * (1.f + (-u_x * c_sq_inv) + (u_x * u_x) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+  d_equ[4] = w1 * local_density * (1.f + (-u_y * c_sq_inv) + (u_y * u_y) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+  d_equ[5] = w2 * local_density * (1.f + ((u_x + u_y) * c_sq_inv) + ((u_x + u_y) * (u_x + u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+  d_equ[6] = w2 * local_density * (1.f + ((-u_x + u_y) * c_sq_inv) + ((-u_x + u_y) * (-u_x + u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+  d_equ[7] = w2 * local_density * (1.f + ((-u_x - u_y) * c_sq_inv) + ((-u_x - u_y) * (-u_x - u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+  d_equ[8] = w2 * local_density * (1.f + ((u_x - u_y) * c_sq_inv) + ((u_x - u_y) * (u_x - u_y)) * (0.5f * c_sq_inv * c_sq_inv) - u_sq * (0.5f * c_sq_inv));
+}
+
+/* collision policies: relax the streamed populations s towards d_equ */
+static inline void sweep_collide_bgk(float s[NSPEEDS], const float d_equ[NSPEEDS], const float omega, const float omega_minus)
+{
+  (void)omega_minus;
+
+  for (int kk = 0; kk < NSPEEDS; kk++)
+    s[kk] = s[kk] + omega * (d_equ[kk] - s[kk]);
+}
+
+/* one pair of opposite populations a, b */
+static inline void sweep_collide_trt_pair(float *a, float *b, const float equ_a, const float equ_b,
+                                          const float omega, const float omega_minus)
+{
+  const float even = 0.5f * (*a + *b - equ_a - equ_b);
+  const float odd = 0.5f * (*a - *b - equ_a + equ_b);
+
+  *a -= omega * even + omega_minus * odd;
+  *b -= omega * even - omega_minus * odd;
+}
+
+static inline void sweep_collide_trt(float s[NSPEEDS], const float d_equ[NSPEEDS], const float omega, const float omega_minus)
+{
+  s[0] = s[0] + omega * (d_equ[0] - s[0]);
+  sweep_collide_trt_pair(&s[1], &s[3], d_equ[1], d_equ[3], omega, omega_minus);
+  sweep_collide_trt_pair(&s[2], &s[4], d_equ[2], d_equ[4], omega, omega_minus);
+  sweep_collide_trt_pair(&s[5], &s[7], d_equ[5], d_equ[7], omega, omega_minus);
+  sweep_collide_trt_pair(&s[6], &s[8], d_equ[6], d_equ[8], omega, omega_minus);
+}
+
+/*
+** Copy n floats to dst with non-temporal stores, plain stores for the
+** floats before the first and after the last vector aligned for them.
+*/
+static inline void sweep_stream(float *restrict dst, const float *restrict src, const int n)
+{
+#ifdef __AVX__
+  const int width = 8;
+#else
+  const int width = 4;
+#endif
+  int ii = 0;
+
+  for (; ii < n && (uintptr_t)(dst + ii) % (width * sizeof(float)) != 0; ii++)
+    dst[ii] = src[ii];
+
+  for (; ii + width <= n; ii += width)
+  {
+#ifdef __AVX__
+    _mm256_stream_ps(dst + ii, _mm256_loadu_ps(src + ii));
+#else
+    _mm_stream_ps(dst + ii, _mm_loadu_ps(src + ii));
+#endif
+  }
+
+  for (; ii < n; ii++)
+    dst[ii] = src[ii];
+}
+
+/* relaxation rate of the odd moments, for the magic parameter */
+static inline float sweep_omega_minus(const float omega)
+{
+  return 1.f / (0.5f + SWEEP_TRT_MAGIC / (1.f / omega - 0.5f));
+}
+
+#endif
+
+/*
+** one instantiation
+*/
+
+#if !defined(SWEEP_NAME) || !defined(SWEEP_LAYOUT) || !defined(SWEEP_COLLISION) || !defined(SWEEP_BOUNDARY)
+#error "define SWEEP_NAME, SWEEP_LAYOUT, SWEEP_COLLISION and SWEEP_BOUNDARY before including sweep.h"
+#endif
+
+#ifndef SWEEP_STORE
+#define SWEEP_STORE SWEEP_CACHED
+#endif
+
+/*
+** Layout policy: the grid type, the pointers the sweep works through
+** (SWEEP_PARAMS/SWEEP_ARGS to pass them on, SWEEP_LOCALS to set them up
+** from the two grids), the population kk of a cell, kk a literal, and
+** the distance between rows of the grid (the obstacle rows are always
+** nx apart).
+*/
+#if SWEEP_LAYOUT == SWEEP_SOA || SWEEP_LAYOUT == SWEEP_PADDED
+#define SWEEP_GRID t_speed
+#define SWEEP_PARAMS                                                                                 \
+  float *restrict src0, float *restrict src1, float *restrict src2, float *restrict src3,            \
+      float *restrict src4, float *restrict src5, float *restrict src6, float *restrict src7,        \
+      float *restrict src8, float *restrict dst0, float *restrict dst1, float *restrict dst2,        \
+      float *restrict dst3, float *restrict dst4, float *restrict dst5, float *restrict dst6,        \
+      float *restrict dst7, float *restrict dst8
+#define SWEEP_ARGS src0, src1, src2, src3, src4, src5, src6, src7, src8, \
+                   dst0, dst1, dst2, dst3, dst4, dst5, dst6, dst7, dst8
+#define SWEEP_LOCALS(cells, tmp_cells)                                                                \
+  float *restrict src0 = (cells)->speeds0, *restrict src1 = (cells)->speeds1;                         \
+  float *restrict src2 = (cells)->speeds2, *restrict src3 = (cells)->speeds3;                         \
+  float *restrict src4 = (cells)->speeds4, *restrict src5 = (cells)->speeds5;                         \
+  float *restrict src6 = (cells)->speeds6, *restrict src7 = (cells)->speeds7;                         \
+  float *restrict src8 = (cells)->speeds8;                                                            \
+  float *restrict dst0 = (tmp_cells)->speeds0, *restrict dst1 = (tmp_cells)->speeds1;                 \
+  float *restrict dst2 = (tmp_cells)->speeds2, *restrict dst3 = (tmp_cells)->speeds3;                 \
+  float *restrict dst4 = (tmp_cells)->speeds4, *restrict dst5 = (tmp_cells)->speeds5;                 \
+  float *restrict dst6 = (tmp_cells)->speeds6, *restrict dst7 = (tmp_cells)->speeds7;                 \
+  float *restrict dst8 = (tmp_cells)->speeds8
+/* the same, storing into the rows of buffer instead of the new grid */
+#define SWEEP_BUFFER_ARGS(buffer) src0, src1, src2, src3, src4, src5, src6, src7, src8, \
+                                  buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], \
+                                  buffer[5], buffer[6], buffer[7], buffer[8]
+#define SWEEP_SRC(kk, cell) src##kk[cell]
+#define SWEEP_DST(kk, cell) dst##kk[cell]
+#if SWEEP_LAYOUT == SWEEP_PADDED
+#define SWEEP_PITCH(nx) PADDED_PITCH(nx)
+#else
+#define SWEEP_PITCH(nx) (nx)
+#endif
+#elif SWEEP_LAYOUT == SWEEP_AOS
+#define SWEEP_GRID t_speed_aos
+#define SWEEP_PARAMS t_speed_aos *restrict src, t_speed_aos *restrict dst
+#define SWEEP_ARGS src, dst
+#define SWEEP_LOCALS(cells, tmp_cells) \
+  t_speed_aos *restrict src = (cells); \
+  t_speed_aos *restrict dst = (tmp_cells)
+#define SWEEP_SRC(kk, cell) src[cell].speeds[kk]
+#define SWEEP_DST(kk, cell) dst[cell].speeds[kk]
+#define SWEEP_PITCH(nx) (nx)
+#elif SWEEP_LAYOUT == SWEEP_AOSOA
+#define SWEEP_GRID t_speed_aosoa
+#define SWEEP_PARAMS t_speed_aosoa *restrict src, t_speed_aosoa *restrict dst
+#define SWEEP_ARGS src, dst
+#define SWEEP_LOCALS(cells, tmp_cells)   \
+  t_speed_aosoa *restrict src = (cells); \
+  t_speed_aosoa *restrict dst = (tmp_cells)
+#define SWEEP_SRC(kk, cell) src[(unsigned)(cell) / AOSOA_WIDTH].speeds[kk][(unsigned)(cell) % AOSOA_WIDTH]
+#define SWEEP_DST(kk, cell) dst[(unsigned)(cell) / AOSOA_WIDTH].speeds[kk][(unsigned)(cell) % AOSOA_WIDTH]
+#define SWEEP_PITCH(nx) (nx)
+#else
+#error "unknown SWEEP_LAYOUT"
+#endif
+
+/* collision policy */
+#if SWEEP_COLLISION == SWEEP_BGK
+#define SWEEP_COLLIDE sweep_collide_bgk
+#elif SWEEP_COLLISION == SWEEP_TRT
+#define SWEEP_COLLIDE sweep_collide_trt
+#else
+#error "unknown SWEEP_COLLISION"
+#endif
+
+/* store policy */
+#if SWEEP_STORE == SWEEP_STREAMING
+#if (SWEEP_LAYOUT != SWEEP_SOA && SWEEP_LAYOUT != SWEEP_PADDED) || SWEEP_BOUNDARY != SWEEP_PEELED
+#error "SWEEP_STREAMING needs SWEEP_SOA or SWEEP_PADDED, and SWEEP_PEELED"
+#endif
+#elif SWEEP_STORE != SWEEP_CACHED
+#error "unknown SWEEP_STORE"
+#endif
+
+#if defined(SWEEP_TILES) && (SWEEP_BOUNDARY != SWEEP_PEELED || SWEEP_STORE != SWEEP_CACHED)
+#error "SWEEP_TILES needs SWEEP_PEELED and SWEEP_CACHED"
+#endif
+
+/*
+** Stream into cell ii of the row starting at row, from the columns x_e
+** and x_w and the rows row_n and row_s around it, then bounce back if
+** obstacle is set or collide, storing the new state at out. Returns the
+** speed of the new state, 0 in obstacle cells. Called with obstacle 0,
+** the bounce back compiles away.
+*/
+static inline float SWEEP_CAT(SWEEP_NAME, cell)(SWEEP_PARAMS, const int obstacle,
+                                                const float omega, const float omega_minus,
+                                                const int ii, const int x_e, const int x_w,
+                                                const int row, const int row_n, const int row_s,
+                                                const int out)
+{
+  const int cell = ii + row;
+  float s[NSPEEDS];
+
+  s[0] = SWEEP_SRC(0, cell);            /* central cell, no movement */
+  s[1] = SWEEP_SRC(1, x_w + row);       /* east */
+  s[2] = SWEEP_SRC(2, ii + row_s);      /* north */
+  s[3] = SWEEP_SRC(3, x_e + row);       /* west */
+  s[4] = SWEEP_SRC(4, ii + row_n);      /* south */
+  s[5] = SWEEP_SRC(5, x_w + row_s);     /* north-east */
+  s[6] = SWEEP_SRC(6, x_e + row_s);     /* north-west */
+  s[7] = SWEEP_SRC(7, x_e + row_n);     /* south-west */
+  s[8] = SWEEP_SRC(8, x_w + row_n);     /* south-east */
+
+  if (obstacle)
+  {
+    /* bounce back, leaving the rest population as it was */
+#if SWEEP_STORE == SWEEP_STREAMING
+    SWEEP_DST(0, out) = s[0]; /* the whole block is copied out */
+#endif
+    SWEEP_DST(1, out) = s[3];
+    SWEEP_DST(2, out) = s[4];
+    SWEEP_DST(3, out) = s[1];
+    SWEEP_DST(4, out) = s[2];
+    SWEEP_DST(5, out) = s[7];
+    SWEEP_DST(6, out) = s[8];
+    SWEEP_DST(7, out) = s[5];
+    SWEEP_DST(8, out) = s[6];
+
+    return 0.f;
+  }
+
+  const float local_density = s[0] + s[1] + s[2] + s[3] + s[4] + s[5] + s[6] + s[7] + s[8];
+  const float u_x = (s[1] + s[5] + s[8] - (s[3] + s[6] + s[7])) / local_density;
+  const float u_y = (s[2] + s[5] + s[6] - (s[4] + s[7] + s[8])) / local_density;
+  float d_equ[NSPEEDS];
+
+  sweep_equilibrium(local_density, u_x, u_y, d_equ);
+  SWEEP_COLLIDE(s, d_equ, omega, omega_minus);
+
+  SWEEP_DST(0, out) = s[0];
+  SWEEP_DST(1, out) = s[1];
+  SWEEP_DST(2, out) = s[2];
+  SWEEP_DST(3, out) = s[3];
+  SWEEP_DST(4, out) = s[4];
+  SWEEP_DST(5, out) = s[5];
+  SWEEP_DST(6, out) = s[6];
+  SWEEP_DST(7, out) = s[7];
+  SWEEP_DST(8, out) = s[8];
+
+  return sqrtf(u_x * u_x + u_y * u_y);
+}
+
+/* accelerate_flow() on the second row from the top */
+static inline void SWEEP_CAT(SWEEP_NAME, accelerate)(SWEEP_PARAMS, const t_param params, const int nx, const int ny,
+                                                      const int *restrict obstacles)
+{
+  const float w1 = params.density * params.accel / 9.f;
+  const float w2 = params.density * params.accel / 36.f;
+  const int row = (ny - 2) * SWEEP_PITCH(nx);
+  const int obstacle_row = (ny - 2) * nx;
+
+#pragma omp simd
+  for (int ii = 0; ii < nx; ii++)
+  {
+    const int cell = ii + row;
+
+    /* if the cell is not occupied and we don't send a negative density */
+    if (!obstacles[ii + obstacle_row] && (SWEEP_SRC(3, cell) - w1) > 0.f && (SWEEP_SRC(6, cell) - w2) > 0.f && (SWEEP_SRC(7, cell) - w2) > 0.f)
+    {
+      SWEEP_SRC(1, cell) += w1;
+      SWEEP_SRC(5, cell) += w2;
+      SWEEP_SRC(8, cell) += w2;
+      SWEEP_SRC(3, cell) -= w1;
+      SWEEP_SRC(6, cell) -= w2;
+      SWEEP_SRC(7, cell) -= w2;
+    }
+  }
+}
+
+float SWEEP_NAME(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles)
+{
+  SWEEP_GRID *cells = *cells_ptr;
+  SWEEP_GRID *tmp_cells = *tmp_cells_ptr;
+  const float omega = params.omega;
+  const float omega_minus = sweep_omega_minus(params.omega);
+#ifdef SWEEP_NX
+  const int nx = SWEEP_NX;
+  const int ny = SWEEP_NY;
+#else
+  const int nx = params.nx;
+  const int ny = params.ny;
+#endif
+  const int pitch = SWEEP_PITCH(nx);
+#ifdef SWEEP_TILES
+  const unsigned char *tiles = tile_map(params, obstacles);
+#endif
+  float tot_u = 0.f;
+  int tot_cells = 0;
+
+  SWEEP_LOCALS(cells, tmp_cells);
+
+  PROFILE_TIC(accel_tic);
+  const double accel_trace_tic = trace.active ? monotonic_clock() : 0.0;
+  SWEEP_CAT(SWEEP_NAME, accelerate)(SWEEP_ARGS, params, nx, ny, obstacles);
+  if (trace.active)
+    trace_span(TRACE_MAIN, "accelerate_flow", accel_trace_tic, monotonic_clock());
+  PROFILE_RECORD(0, PHASE_ACCELERATE, accel_tic);
+
+#pragma omp parallel reduction(+ : tot_u, tot_cells)
+  {
+    PROFILE_TIC(sweep_tic);
+    const double trace_tic = trace.active ? monotonic_clock() : 0.0;
+
+#pragma omp for schedule(runtime) nowait
+    for (int jj = 0; jj < ny; jj++)
+    {
+      const int row = jj * pitch;
+      const int row_n = (jj == ny - 1) ? 0 : row + pitch;
+      const int row_s = (jj == 0) ? (ny - 1) * pitch : row - pitch;
+      const int obstacle_row = jj * nx;
+
+/* cell ii of this row, through the pointers args */
+#define SWEEP_CELL(args, obstacle, ii, x_e, x_w, out) \
+  SWEEP_CAT(SWEEP_NAME, cell)(args, obstacle, omega, omega_minus, ii, x_e, x_w, row, row_n, row_s, out)
+
+#if SWEEP_BOUNDARY == SWEEP_WRAP
+#pragma omp simd reduction(+ : tot_u, tot_cells)
+      for (int ii = 0; ii < nx; ii++)
+      {
+        const int x_e = (ii == nx - 1) ? 0 : ii + 1;
+        const int x_w = (ii == 0) ? nx - 1 : ii - 1;
+
+        tot_u += SWEEP_CELL(SWEEP_ARGS, obstacles[ii + obstacle_row], ii, x_e, x_w, ii + row);
+        tot_cells += !obstacles[ii + obstacle_row];
+      }
+#elif SWEEP_STORE == SWEEP_STREAMING
+      float buffer[NSPEEDS][SWEEP_STREAM_BLOCK];
+      float *dst[NSPEEDS] = {dst0, dst1, dst2, dst3, dst4, dst5, dst6, dst7, dst8};
+
+      for (int start = 0; start < nx; start += SWEEP_STREAM_BLOCK)
+      {
+        const int end = (nx - start > SWEEP_STREAM_BLOCK) ? start + SWEEP_STREAM_BLOCK : nx;
+        const int first = (start == 0) ? 1 : start;
+        const int last = (end == nx) ? nx - 1 : end;
+
+        if (start == 0)
+        {
+          tot_u += SWEEP_CELL(SWEEP_BUFFER_ARGS(buffer), obstacles[obstacle_row], 0, 1, nx - 1, 0);
+          tot_cells += !obstacles[obstacle_row];
+        }
+
+#pragma omp simd reduction(+ : tot_u, tot_cells)
+        for (int ii = first; ii < last; ii++)
+        {
+          tot_u += SWEEP_CELL(SWEEP_BUFFER_ARGS(buffer), obstacles[ii + obstacle_row], ii, ii + 1, ii - 1, ii - start);
+          tot_cells += !obstacles[ii + obstacle_row];
+        }
+
+        if (end == nx)
+        {
+          tot_u += SWEEP_CELL(SWEEP_BUFFER_ARGS(buffer), obstacles[nx - 1 + obstacle_row], nx - 1, 0, nx - 2,
+                              nx - 1 - start);
+          tot_cells += !obstacles[nx - 1 + obstacle_row];
+        }
+
+        for (int kk = 0; kk < NSPEEDS; kk++)
+          sweep_stream(dst[kk] + row + start, buffer[kk], end - start);
+      }
+#elif defined(SWEEP_TILES)
+      const unsigned char *tile_row = tiles + jj / TILE_SIZE * TILES(nx);
+
+      /* runs of tiles of one kind */
+      for (int tile = 0; tile < TILES(nx);)
+      {
+        const int kind = tile_row[tile];
+        int next = tile + 1;
+
+        while (next < TILES(nx) && tile_row[next] == kind)
+          next++;
+
+        int first = tile * TILE_SIZE;
+        int last = (next * TILE_SIZE < nx) ? next * TILE_SIZE : nx;
+        const int peel_last = (last == nx);
+
+        tile = next;
+
+        if (kind == TILE_SOLID)
+          continue;
+
+        if (first == 0)
+        {
+          tot_u += SWEEP_CELL(SWEEP_ARGS, obstacles[obstacle_row], 0, 1, nx - 1, row);
+          tot_cells += !obstacles[obstacle_row];
+          first = 1;
+        }
+
+        if (peel_last)
+          last = nx - 1;
+
+        if (kind == TILE_FLUID)
+        {
+#pragma omp simd reduction(+ : tot_u)
+          for (int ii = first; ii < last; ii++)
+            tot_u += SWEEP_CELL(SWEEP_ARGS, 0, ii, ii + 1, ii - 1, ii + row);
+
+          tot_cells += (last > first) ? last - first : 0;
+        }
+        else
+        {
+#pragma omp simd reduction(+ : tot_u, tot_cells)
+          for (int ii = first; ii < last; ii++)
+          {
+            tot_u += SWEEP_CELL(SWEEP_ARGS, obstacles[ii + obstacle_row], ii, ii + 1, ii - 1, ii + row);
+            tot_cells += !obstacles[ii + obstacle_row];
+          }
+        }
+
+        if (peel_last)
+        {
+          tot_u += SWEEP_CELL(SWEEP_ARGS, obstacles[nx - 1 + obstacle_row], nx - 1, 0, nx - 2, nx - 1 + row);
+          tot_cells += !obstacles[nx - 1 + obstacle_row];
+        }
+      }
+#elif SWEEP_BOUNDARY == SWEEP_PEELED
+      tot_u += SWEEP_CELL(SWEEP_ARGS, obstacles[obstacle_row], 0, 1, nx - 1, row);
+      tot_cells += !obstacles[obstacle_row];
+
+#pragma omp simd reduction(+ : tot_u, tot_cells)
+      for (int ii = 1; ii < nx - 1; ii++)
+      {
+        tot_u += SWEEP_CELL(SWEEP_ARGS, obstacles[ii + obstacle_row], ii, ii + 1, ii - 1, ii + row);
+        tot_cells += !obstacles[ii + obstacle_row];
+      }
+
+      tot_u += SWEEP_CELL(SWEEP_ARGS, obstacles[nx - 1 + obstacle_row], nx - 1, 0, nx - 2, nx - 1 + row);
+      tot_cells += !obstacles[nx - 1 + obstacle_row];
+#else
+#error "unknown SWEEP_BOUNDARY"
+#endif
+#undef SWEEP_CELL
+    }
+
+#if SWEEP_STORE == SWEEP_STREAMING
+    /* non-temporal stores are weakly ordered: drain them before the barrier and the swap */
+    _mm_sfence();
+#endif
+
+    PROFILE_RECORD(omp_get_thread_num(), PHASE_SWEEP, sweep_tic);
+    phase_sweep_done(trace_tic);
+  }
+
+  phase_region_done();
+
+  *cells_ptr = tmp_cells;
+  *tmp_cells_ptr = cells;
+
+  return tot_u / (float)tot_cells;
+}
+
+#undef SWEEP_GRID
+#undef SWEEP_PARAMS
+#undef SWEEP_ARGS
+#undef SWEEP_BUFFER_ARGS
+#undef SWEEP_LOCALS
+#undef SWEEP_SRC
+#undef SWEEP_DST
+#undef SWEEP_PITCH
+#undef SWEEP_COLLIDE
+#undef SWEEP_NAME
+#undef SWEEP_LAYOUT
+#undef SWEEP_COLLISION
+#undef SWEEP_BOUNDARY
+#undef SWEEP_NX
+#undef SWEEP_NY
+#undef SWEEP_STORE
+#undef SWEEP_TILES
@@ -0,0 +1,325 @@
+/*
+** Kernel variants generated from the policy-based sweep template
+** (sweep.h), registered in kernels.c as sweep-*. sweep-soa is the
+** combination timestep() hand-codes, for checking that the template
+** costs nothing; the others change one policy each.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "d2q9-bgk.h"
+
+#define SWEEP_NAME sweep_soa_step
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_WRAP
+#include "sweep.h"
+
+#define SWEEP_NAME sweep_soa_peeled_step
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#include "sweep.h"
+
+#define SWEEP_NAME sweep_aos_step
+#define SWEEP_LAYOUT SWEEP_AOS
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_WRAP
+#include "sweep.h"
+
+#define SWEEP_NAME sweep_aosoa_step
+#define SWEEP_LAYOUT SWEEP_AOSOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#include "sweep.h"
+
+#define SWEEP_NAME sweep_soa_padded_step
+#define SWEEP_LAYOUT SWEEP_PADDED
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#include "sweep.h"
+
+#define SWEEP_NAME sweep_soa_trt_step
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_TRT
+#define SWEEP_BOUNDARY SWEEP_WRAP
+#include "sweep.h"
+
+/*
+** sweep-soa-nt: sweep-soa-peeled, storing the new grid with non-temporal
+** stores once the two grids are bigger than the stream threshold, where
+** every line it writes would otherwise be read in first, only to be
+** evicted again before the next step reads it. The threshold is the last
+** level cache, or D2Q9_STREAM_THRESHOLD MiB (0 always streams).
+*/
+#define SWEEP_NAME sweep_soa_stream_step
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#define SWEEP_STORE SWEEP_STREAMING
+#include "sweep.h"
+
+#define STREAM_THRESHOLD_DEFAULT (32L << 20) /* if the cache size is unknown */
+
+/* the last level cache in bytes, 0 if unknown */
+static long llc_bytes(void)
+{
+  long bytes = 0;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+  bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+
+  if (bytes <= 0)
+  {
+    FILE *fp = fopen("/sys/devices/system/cpu/cpu0/cache/index3/size", "r");
+    char unit = 'K';
+
+    bytes = 0;
+
+    if (fp != NULL)
+    {
+      if (fscanf(fp, "%ld%c", &bytes, &unit) >= 1)
+        bytes <<= (unit == 'M') ? 20 : (unit == 'K') ? 10 : 0;
+
+      fclose(fp);
+    }
+  }
+
+  return bytes > 0 ? bytes : 0;
+}
+
+static long stream_threshold(void)
+{
+  static long threshold = -1;
+
+  if (threshold < 0)
+  {
+    const char *env = getenv("D2Q9_STREAM_THRESHOLD");
+
+    if (env != NULL)
+    {
+      char *end;
+      const long mib = strtol(env, &end, 10);
+
+      if (end == env || *end != '\0' || mib < 0)
+        die("D2Q9_STREAM_THRESHOLD must be a non-negative number of MiB", __LINE__, __FILE__);
+
+      threshold = mib << 20;
+    }
+    else
+    {
+      threshold = llc_bytes();
+
+      if (threshold == 0)
+        threshold = STREAM_THRESHOLD_DEFAULT;
+    }
+  }
+
+  return threshold;
+}
+
+int sweep_soa_nt_streams(const t_param params)
+{
+  return 2L * NSPEEDS * sizeof(float) * params.nx * params.ny > (unsigned long)stream_threshold();
+}
+
+float sweep_soa_nt_step(const t_param params, void **cells_ptr, void **tmp_cells_ptr, int *obstacles)
+{
+  if (sweep_soa_nt_streams(params))
+    return sweep_soa_stream_step(params, cells_ptr, tmp_cells_ptr, obstacles);
+
+  return sweep_soa_peeled_step(params, cells_ptr, tmp_cells_ptr, obstacles);
+}
+
+/*
+** sweep-soa-tiled: sweep-soa-peeled by runs of 8x8 tiles of the tile
+** activity map, which kernel_grids_open() builds.
+*/
+#define SWEEP_NAME sweep_soa_tiled_step
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#define SWEEP_TILES
+#include "sweep.h"
+
+/*
+** sweep-fixed: sweep-soa-peeled compiled once per grid size in the
+** FIXED_NX_n, FIXED_NY_n list (n from 0 to 7), which make sets from
+** SIZES, defaulting to the four shipped problems. kernel_for_grid()
+** swaps the kernel for the one compiled for the grid, if there is one.
+*/
+#ifndef FIXED_NX_0
+#define FIXED_NX_0 128
+#define FIXED_NY_0 128
+#define FIXED_NX_1 128
+#define FIXED_NY_1 256
+#define FIXED_NX_2 256
+#define FIXED_NY_2 256
+#define FIXED_NX_3 1024
+#define FIXED_NY_3 1024
+#endif
+
+/* the generic sweep, for every other size */
+#define SWEEP_NAME sweep_fixed_step
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#include "sweep.h"
+
+#ifdef FIXED_NX_0
+#define SWEEP_NAME sweep_fixed_step_0
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#define SWEEP_NX FIXED_NX_0
+#define SWEEP_NY FIXED_NY_0
+#include "sweep.h"
+#endif
+
+#ifdef FIXED_NX_1
+#define SWEEP_NAME sweep_fixed_step_1
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#define SWEEP_NX FIXED_NX_1
+#define SWEEP_NY FIXED_NY_1
+#include "sweep.h"
+#endif
+
+#ifdef FIXED_NX_2
+#define SWEEP_NAME sweep_fixed_step_2
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#define SWEEP_NX FIXED_NX_2
+#define SWEEP_NY FIXED_NY_2
+#include "sweep.h"
+#endif
+
+#ifdef FIXED_NX_3
+#define SWEEP_NAME sweep_fixed_step_3
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#define SWEEP_NX FIXED_NX_3
+#define SWEEP_NY FIXED_NY_3
+#include "sweep.h"
+#endif
+
+#ifdef FIXED_NX_4
+#define SWEEP_NAME sweep_fixed_step_4
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#define SWEEP_NX FIXED_NX_4
+#define SWEEP_NY FIXED_NY_4
+#include "sweep.h"
+#endif
+
+#ifdef FIXED_NX_5
+#define SWEEP_NAME sweep_fixed_step_5
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#define SWEEP_NX FIXED_NX_5
+#define SWEEP_NY FIXED_NY_5
+#include "sweep.h"
+#endif
+
+#ifdef FIXED_NX_6
+#define SWEEP_NAME sweep_fixed_step_6
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#define SWEEP_NX FIXED_NX_6
+#define SWEEP_NY FIXED_NY_6
+#include "sweep.h"
+#endif
+
+#ifdef FIXED_NX_7
+#define SWEEP_NAME sweep_fixed_step_7
+#define SWEEP_LAYOUT SWEEP_SOA
+#define SWEEP_COLLISION SWEEP_BGK
+#define SWEEP_BOUNDARY SWEEP_PEELED
+#define SWEEP_NX FIXED_NX_7
+#define SWEEP_NY FIXED_NY_7
+#include "sweep.h"
+#endif
+
+#define FIXED_STR_(x) #x
+#define FIXED_STR(x) FIXED_STR_(x)
+#define FIXED_KERNEL(n)                                                                                        \
+  {                                                                                                            \
+    FIXED_NX_##n, FIXED_NY_##n,                                                                                \
+    {                                                                                                          \
+      "sweep-fixed-" FIXED_STR(FIXED_NX_##n) "x" FIXED_STR(FIXED_NY_##n),                                      \
+          "sweep-fixed compiled for " FIXED_STR(FIXED_NX_##n) "x" FIXED_STR(FIXED_NY_##n), LAYOUT_SOA, 76,     \
+          sweep_fixed_step_##n, MODEL_BGK, 1                                                                   \
+    }                                                                                                          \
+  }
+
+/* struct to hold one size the sweep is compiled for */
+typedef struct
+{
+  int nx;
+  int ny;
+  t_kernel kernel;
+} t_fixed;
+
+static const t_fixed fixed[] = {
+#ifdef FIXED_NX_0
+    FIXED_KERNEL(0),
+#endif
+#ifdef FIXED_NX_1
+    FIXED_KERNEL(1),
+#endif
+#ifdef FIXED_NX_2
+    FIXED_KERNEL(2),
+#endif
+#ifdef FIXED_NX_3
+    FIXED_KERNEL(3),
+#endif
+#ifdef FIXED_NX_4
+    FIXED_KERNEL(4),
+#endif
+#ifdef FIXED_NX_5
+    FIXED_KERNEL(5),
+#endif
+#ifdef FIXED_NX_6
+    FIXED_KERNEL(6),
+#endif
+#ifdef FIXED_NX_7
+    FIXED_KERNEL(7),
+#endif
+};
+
+const t_kernel *kernel_for_grid(const t_kernel *kernel, const t_param params)
+{
+  if (kernel->step != sweep_fixed_step)
+    return kernel;
+
+  for (int ff = 0; ff < (int)(sizeof(fixed) / sizeof(fixed[0])); ff++)
+  {
+    if (fixed[ff].nx == params.nx && fixed[ff].ny == params.ny)
+      return &fixed[ff].kernel;
+  }
+
+  return kernel;
+}
+
+void list_fixed_sizes(void)
+{
+  printf("sweep-fixed is compiled for");
+
+  for (int ff = 0; ff < (int)(sizeof(fixed) / sizeof(fixed[0])); ff++)
+    printf(" %dx%d", fixed[ff].nx, fixed[ff].ny);
+
+  printf("\n");
+}
@@ -0,0 +1,318 @@
+/*
+** Startup autotuner and its on-disk cache.
+**
+** With --autotune the solver times short trial runs of a private copy
+** of the problem over kernel variants, OpenMP thread counts, OpenMP
+** schedules and row-tile (chunk) sizes, and stores the fastest
+** configuration in the tuning cache. Later runs of a problem with the
+** same key pick the cached configuration up automatically.
+**
+** The key is (nx, ny, obstacle density, CPU model). The cache is a text
+** file with one entry per line:
+**
+**   nx ny density threads schedule chunk kernel mlups cpu model...
+**
+** The CPU model goes last as it contains spaces.
+**
+** The search is greedy rather than exhaustive: the kernel is picked at
+** the full thread count with a static schedule, then (for the OpenMP
+** parallel kernels, the only ones the other settings affect) the thread
+** count, and then the schedule and row-tile size at that thread count.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "d2q9-bgk.h"
+
+#define TUNE_LINE_LEN 1024
+#define TUNE_TRIAL_UPDATES 2000000 /* lattice updates per timed trial */
+#define TUNE_WARMUP_STEPS 5        /* untimed steps before each trial */
+#define TUNE_DENSITY_TOLERANCE 0.0005f
+
+static const struct
+{
+  const char *name;
+  omp_sched_t kind;
+} schedules[] = {
+    {"static", omp_sched_static},
+    {"dynamic", omp_sched_dynamic},
+    {"guided", omp_sched_guided},
+};
+
+static const int nschedules = sizeof(schedules) / sizeof(schedules[0]);
+
+/* row-tile sizes tried, 0 being the schedule's default chunking */
+static const int chunks[] = {0, 1, 2, 4, 8, 16, 32, 64};
+
+static const int nchunks = sizeof(chunks) / sizeof(chunks[0]);
+
+const char *schedule_name(int schedule)
+{
+  /* without the monotonic modifier (omp_sched_monotonic in OpenMP 5.0), which OMP_SCHEDULE=static sets */
+  schedule &= 0x7fffffff;
+
+  for (int ss = 0; ss < nschedules; ss++)
+  {
+    if ((int)schedules[ss].kind == schedule)
+      return schedules[ss].name;
+  }
+
+  return "unknown";
+}
+
+static int schedule_kind(const char *name)
+{
+  for (int ss = 0; ss < nschedules; ss++)
+  {
+    if (strcmp(schedules[ss].name, name) == 0)
+      return schedules[ss].kind;
+  }
+
+  return -1;
+}
+
+float obstacle_density(const t_param params, const int *obstacles)
+{
+  long blocked = 0;
+
+  for (int ii = 0; ii < params.nx * params.ny; ii++)
+    blocked += obstacles[ii] != 0;
+
+  return (float)blocked / ((float)params.nx * params.ny);
+}
+
+/* read one cache line into tune and its key, returning 0 if it is malformed */
+static int parse_entry(const char *line, int *nx, int *ny, float *density, char *cpu, t_tune *tune)
+{
+  char schedule[32];
+  char kernel[64];
+  int offset = 0;
+
+  if (sscanf(line, "%d %d %f %d %31s %d %63s %lf %n", nx, ny, density, &tune->threads, schedule,
+             &tune->chunk, kernel, &tune->mlups, &offset) != 8 ||
+      offset == 0)
+    return 0;
+
+  tune->schedule = schedule_kind(schedule);
+  tune->kernel = find_kernel(kernel);
+
+  if (tune->schedule < 0 || tune->kernel == NULL || tune->threads < 1 || tune->chunk < 0)
+    return 0;
+
+  strncpy(cpu, line + offset, TUNE_LINE_LEN - 1);
+  cpu[TUNE_LINE_LEN - 1] = '\0';
+  cpu[strcspn(cpu, "\n")] = '\0';
+
+  return 1;
+}
+
+int tune_lookup(const char *cache, const t_param params, const int *obstacles, t_tune *tune)
+{
+  char line[TUNE_LINE_LEN];
+  char cpu[TUNE_LINE_LEN];
+  char entry_cpu[TUNE_LINE_LEN];
+  int nx, ny;
+  float density;
+  FILE *fp = fopen(cache, "r");
+
+  if (fp == NULL)
+    return 0;
+
+  cpu_model(cpu, sizeof(cpu));
+  const float our_density = obstacle_density(params, obstacles);
+  int found = 0;
+
+  while (!found && fgets(line, sizeof(line), fp))
+  {
+    found = parse_entry(line, &nx, &ny, &density, entry_cpu, tune) &&
+            nx == params.nx && ny == params.ny &&
+            fabsf(density - our_density) < TUNE_DENSITY_TOLERANCE &&
+            strcmp(entry_cpu, cpu) == 0;
+  }
+
+  fclose(fp);
+
+  return found;
+}
+
+/* replace any entry with the same key as tune in the cache, or add one */
+static void tune_store(const char *cache, const t_param params, float density, const char *cpu, const t_tune *tune)
+{
+  char line[TUNE_LINE_LEN];
+  char entry_cpu[TUNE_LINE_LEN];
+  char tmpfile[TUNE_LINE_LEN];
+  int nx, ny;
+  float entry_density;
+  t_tune entry;
+
+  snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", cache);
+  FILE *out = fopen(tmpfile, "w");
+
+  if (out == NULL)
+  {
+    fprintf(stderr, "warning: could not write tuning cache %s\n", tmpfile);
+    return;
+  }
+
+  /* keep the other entries, and any line we do not understand */
+  FILE *in = fopen(cache, "r");
+
+  if (in != NULL)
+  {
+    while (fgets(line, sizeof(line), in))
+    {
+      if (parse_entry(line, &nx, &ny, &entry_density, entry_cpu, &entry) &&
+          nx == params.nx && ny == params.ny &&
+          fabsf(entry_density - density) < TUNE_DENSITY_TOLERANCE &&
+          strcmp(entry_cpu, cpu) == 0)
+        continue;
+
+      fputs(line, out);
+    }
+
+    fclose(in);
+  }
+
+  fprintf(out, "%d %d %.4f %d %s %d %s %.3lf %s\n", params.nx, params.ny, density, tune->threads,
+          schedule_name(tune->schedule), tune->chunk, tune->kernel->name, tune->mlups, cpu);
+  fclose(out);
+
+  if (rename(tmpfile, cache) != 0)
+    fprintf(stderr, "warning: could not replace tuning cache %s\n", cache);
+}
+
+/* time one configuration on the trial grids, returning its MLUPS */
+static double tune_trial(const t_param params, t_speed **cells_ptr, t_speed **tmp_cells_ptr, int *obstacles,
+                         const t_kernel *kernel, int threads, int schedule, int chunk)
+{
+  void *grid = NULL;
+  void *tmp_grid = NULL;
+  int steps = TUNE_TRIAL_UPDATES / (params.nx * params.ny);
+
+  if (steps < 10)
+    steps = 10;
+
+  omp_set_num_threads(threads);
+  omp_set_schedule((omp_sched_t)schedule, chunk);
+  numa_pin_threads();
+  kernel = kernel_for_grid(kernel, params);
+  kernel_grids_open(kernel, params, *cells_ptr, *tmp_cells_ptr, obstacles, &grid, &tmp_grid);
+
+  for (int tt = 0; tt < TUNE_WARMUP_STEPS; tt++)
+    kernel->step(params, &grid, &tmp_grid, obstacles);
+
+  const double tic = monotonic_clock();
+
+  for (int tt = 0; tt < steps; tt++)
+    kernel->step(params, &grid, &tmp_grid, obstacles);
+
+  const double toc = monotonic_clock();
+
+  kernel_grids_close(kernel, params, cells_ptr, tmp_cells_ptr, grid, tmp_grid);
+
+  const double mlups = (double)params.nx * params.ny * steps / (toc - tic) / 1.0e6;
+
+  printf("autotune: %-16s threads %3d  schedule %-7s chunk %3d  %10.3lf MLUPS\n",
+         kernel->name, threads, schedule_name(schedule), chunk, mlups);
+
+  return mlups;
+}
+
+/* keep the trial configuration if it beats the best so far */
+static void tune_consider(t_tune *best, double mlups, const t_kernel *kernel, int threads, int schedule, int chunk)
+{
+  if (mlups > best->mlups)
+  {
+    best->mlups = mlups;
+    best->kernel = kernel;
+    best->threads = threads;
+    best->schedule = schedule;
+    best->chunk = chunk;
+  }
+}
+
+void autotune(const char *paramfile, const char *obstaclefile, const char *cache, t_tune *best)
+{
+  t_options options;
+  t_param params;
+  t_speed *cells = NULL;
+  t_speed *tmp_cells = NULL;
+  int *obstacles = NULL;
+  float *av_vels = NULL;
+  char cpu[TUNE_LINE_LEN];
+  const int max_threads = omp_get_max_threads();
+  omp_sched_t schedule;
+  int chunk;
+
+  /* the trials set both; put them back so OMP_NUM_THREADS and OMP_SCHEDULE still win over the tuned values */
+  omp_get_schedule(&schedule, &chunk);
+
+  /* a private copy of the problem, so the trials do not advance the real run */
+  memset(&options, 0, sizeof(options));
+  initialise(paramfile, obstaclefile, &options, &params, &cells, &tmp_cells, &obstacles, &av_vels);
+
+#ifdef PROFILE_PHASES
+  /* current_step() records its phases whatever the caller */
+  profile_init(max_threads);
+#endif
+
+  memset(best, 0, sizeof(*best));
+
+  /* kernel, at every thread, among those giving the results of the BGK model */
+  for (int kk = 0; kk < nkernels; kk++)
+  {
+    if (kernels[kk].model != MODEL_BGK)
+      continue;
+
+    const double mlups = tune_trial(params, &cells, &tmp_cells, obstacles, &kernels[kk], max_threads, omp_sched_static, 0);
+    tune_consider(best, mlups, &kernels[kk], max_threads, omp_sched_static, 0);
+  }
+
+  if (best->kernel->parallel)
+  {
+    /* thread count, with powers of two below the maximum */
+    for (int threads = 1; threads < max_threads; threads *= 2)
+    {
+      const double mlups = tune_trial(params, &cells, &tmp_cells, obstacles, best->kernel, threads, omp_sched_static, 0);
+      tune_consider(best, mlups, best->kernel, threads, omp_sched_static, 0);
+    }
+
+    /* schedule and row-tile size, tiles no bigger than one thread's share of the rows */
+    const int threads = best->threads;
+
+    for (int ss = 0; ss < nschedules; ss++)
+    {
+      for (int cc = 0; cc < nchunks; cc++)
+      {
+        if (chunks[cc] * threads > params.ny || (schedules[ss].kind == omp_sched_static && chunks[cc] == 0))
+          continue;
+
+        const double mlups = tune_trial(params, &cells, &tmp_cells, obstacles, best->kernel, threads, schedules[ss].kind, chunks[cc]);
+        tune_consider(best, mlups, best->kernel, threads, schedules[ss].kind, chunks[cc]);
+      }
+    }
+  }
+  else
+  {
+    /* the serial ported variants ignore the OpenMP settings */
+    best->threads = 1;
+  }
+
+#ifdef PROFILE_PHASES
+  profile_free();
+#endif
+
+  cpu_model(cpu, sizeof(cpu));
+  tune_store(cache, params, obstacle_density(params, obstacles), cpu, best);
+  finalise(&params, &cells, &tmp_cells, &obstacles, &av_vels);
+
+  omp_set_num_threads(max_threads);
+  omp_set_schedule(schedule, chunk);
+  numa_pin_threads();
+}
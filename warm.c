@@ -0,0 +1,223 @@
+/*
+** Coarse-to-fine multilevel warm start.
+**
+** Most of the steps of a steady-state run go on momentum slowly
+** diffusing across the lattice from the accelerated row. With
+** --warm-start=F the same problem is first run on a lattice F times
+** coarser in each direction, and its flow is prolongated onto the fine
+** lattice as the initial state.
+**
+** The coarse problem keeps the Reynolds number under diffusive
+** scaling: a coarse step covers F^2 fine steps of time, the viscosity
+** in lattice units, and so omega, is unchanged, and the lattice
+** velocity is F times larger. accelerate_flow() forces the row next to
+** the top wall, whose velocity is set by the balance of the forcing
+** against the shear at that wall, a single cell away on either
+** lattice, so accel is F times larger too. The steady state is then
+** F^2 times fewer steps away, each 1/F^2 of the work.
+**
+** A coarse cell is blocked if any of its fine cells are, so walls one
+** cell thick survive. The fine populations are the equilibrium of the
+** density and velocity interpolated bilinearly from the open coarse
+** cells around them, the velocity scaled back by 1/F.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "d2q9-bgk.h"
+
+#define WARM_START_TOL 1e-7f /* fine run tolerance the coarse run aims at, unless --converge gives one */
+
+/* density and velocity of every coarse cell, zero for blocked ones */
+static void macroscopic(const t_param params, const t_speed *cells, const int *obstacles,
+                        float *rho, float *u_x, float *u_y)
+{
+#pragma omp parallel for
+  for (int ii = 0; ii < params.nx * params.ny; ii++)
+  {
+    if (obstacles[ii])
+    {
+      rho[ii] = u_x[ii] = u_y[ii] = 0.f;
+      continue;
+    }
+
+    const float local_density = cells->speeds0[ii] + cells->speeds1[ii] + cells->speeds2[ii] +
+                                cells->speeds3[ii] + cells->speeds4[ii] + cells->speeds5[ii] +
+                                cells->speeds6[ii] + cells->speeds7[ii] + cells->speeds8[ii];
+
+    rho[ii] = local_density;
+    u_x[ii] = (cells->speeds1[ii] + cells->speeds5[ii] + cells->speeds8[ii] -
+               (cells->speeds3[ii] + cells->speeds6[ii] + cells->speeds7[ii])) / local_density;
+    u_y[ii] = (cells->speeds2[ii] + cells->speeds5[ii] + cells->speeds6[ii] -
+               (cells->speeds4[ii] + cells->speeds7[ii] + cells->speeds8[ii])) / local_density;
+  }
+}
+
+/* fill the open fine cells with the equilibrium of the interpolated coarse flow */
+static void prolongate(const t_param params, const int *obstacles, t_speed *cells, const t_param coarse,
+                       const int *coarse_obstacles, const float *rho, const float *u_x, const float *u_y,
+                       int factor)
+{
+#pragma omp parallel for
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    /* coarse cell centres are at (F - 1) / 2 + F * index in fine cells */
+    const float y = (jj + 0.5f) / factor - 0.5f;
+    const int j0 = (int)floorf(y);
+    const float fy = y - j0;
+
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      const int cell = ii + jj * params.nx;
+
+      if (obstacles[cell])
+        continue;
+
+      const float x = (ii + 0.5f) / factor - 0.5f;
+      const int i0 = (int)floorf(x);
+      const float fx = x - i0;
+      float weight = 0.f;
+      float d = 0.f;
+      float ux = 0.f;
+      float uy = 0.f;
+
+      /* the four surrounding coarse cells, wrapping round the periodic boundaries */
+      for (int cc = 0; cc < 4; cc++)
+      {
+        const int ci = ((i0 + (cc & 1)) % coarse.nx + coarse.nx) % coarse.nx;
+        const int cj = ((j0 + (cc >> 1)) % coarse.ny + coarse.ny) % coarse.ny;
+        const int coarse_cell = ci + cj * coarse.nx;
+        const float w = ((cc & 1) ? fx : 1.f - fx) * ((cc >> 1) ? fy : 1.f - fy);
+
+        if (coarse_obstacles[coarse_cell] || w == 0.f)
+          continue;
+
+        weight += w;
+        d += w * rho[coarse_cell];
+        ux += w * u_x[coarse_cell];
+        uy += w * u_y[coarse_cell];
+      }
+
+      /* next to a coarse obstacle only: keep the fluid at rest */
+      if (weight == 0.f)
+        continue;
+
+      d /= weight;
+      ux /= weight * factor;
+      uy /= weight * factor;
+
+      const float u_sq = ux * ux + uy * uy;
+      float u[NSPEEDS];
+      u[1] = ux;
+      u[2] = uy;
+      u[3] = -ux;
+      u[4] = -uy;
+      u[5] = ux + uy;
+      u[6] = -ux + uy;
+      u[7] = -ux - uy;
+      u[8] = ux - uy;
+
+      float d_equ[NSPEEDS];
+      d_equ[0] = w0 * d * (1.f - u_sq * 0.5f * c_sq_inv);
+
+      for (int kk = 1; kk < NSPEEDS; kk++)
+      {
+        const float w = kk < 5 ? w1 : w2;
+        d_equ[kk] = w * d * (1.f + u[kk] * c_sq_inv + (u[kk] * u[kk]) * 0.5f * c_sq_inv * c_sq_inv - u_sq * 0.5f * c_sq_inv);
+      }
+
+      cells->speeds0[cell] = d_equ[0];
+      cells->speeds1[cell] = d_equ[1];
+      cells->speeds2[cell] = d_equ[2];
+      cells->speeds3[cell] = d_equ[3];
+      cells->speeds4[cell] = d_equ[4];
+      cells->speeds5[cell] = d_equ[5];
+      cells->speeds6[cell] = d_equ[6];
+      cells->speeds7[cell] = d_equ[7];
+      cells->speeds8[cell] = d_equ[8];
+    }
+  }
+}
+
+void warm_start(const t_param params, const int *obstacles, const t_options *options, t_speed *cells)
+{
+  const int factor = options->warm_start;
+  t_param coarse = params;
+  t_options coarse_options = *options;
+  t_speed *coarse_cells = NULL;
+  t_speed *coarse_tmp_cells = NULL;
+  int *coarse_obstacles = NULL;
+  float *coarse_av_vels = NULL;
+  void *grid = NULL;
+  void *tmp_grid = NULL;
+  t_converge converge;
+
+  if (params.nx % factor || params.ny % factor || params.ny / factor < 4 || params.nx / factor < 2)
+    die("--warm-start factor must divide nx and ny and leave at least 2x4 coarse cells", __LINE__, __FILE__);
+
+  const double tic = monotonic_clock();
+
+  /* same Reynolds number, see the top of the file */
+  coarse.nx = params.nx / factor;
+  coarse.ny = params.ny / factor;
+  coarse.reynolds_dim = params.reynolds_dim / factor;
+  coarse.accel = params.accel * factor;
+  coarse.maxIters = options->warm_start_iters ? options->warm_start_iters : params.maxIters / (factor * factor);
+
+  allocate_grids(&coarse, &coarse_cells, &coarse_tmp_cells, &coarse_obstacles);
+
+  for (int jj = 0; jj < params.ny; jj++)
+  {
+    for (int ii = 0; ii < params.nx; ii++)
+    {
+      if (obstacles[ii + jj * params.nx])
+        coarse_obstacles[ii / factor + jj / factor * coarse.nx] = 1;
+    }
+  }
+
+  /* a coarse step is F^2 fine steps of time, so changes per step are F^2 times larger */
+  if (coarse_options.converge_tol <= 0.f)
+    coarse_options.converge_tol = WARM_START_TOL;
+
+  coarse_options.converge_tol *= factor * factor;
+
+  /* the fine grid's kernel may have been compiled for the fine size only */
+  const t_kernel *kernel = kernel_for_grid(options->asked ? options->asked : options->kernel, coarse);
+
+  converge_init(&converge, coarse, &coarse_options);
+  kernel_grids_open(kernel, coarse, coarse_cells, coarse_tmp_cells, coarse_obstacles, &grid, &tmp_grid);
+
+  int steps = coarse.maxIters;
+  float av_vel = 0.f;
+
+  for (int tt = 0; tt < coarse.maxIters; tt++)
+  {
+    av_vel = kernel->step(coarse, &grid, &tmp_grid, coarse_obstacles);
+
+    if (converge_check(&converge, coarse, kernel, grid, coarse_obstacles, tt, av_vel))
+    {
+      steps = tt + 1;
+      break;
+    }
+  }
+
+  kernel_grids_close(kernel, coarse, &coarse_cells, &coarse_tmp_cells, grid, tmp_grid);
+
+  /* the coarse scratch grid holds the density and velocity fields */
+  macroscopic(coarse, coarse_cells, coarse_obstacles,
+              coarse_tmp_cells->speeds0, coarse_tmp_cells->speeds1, coarse_tmp_cells->speeds2);
+  prolongate(params, obstacles, cells, coarse, coarse_obstacles,
+             coarse_tmp_cells->speeds0, coarse_tmp_cells->speeds1, coarse_tmp_cells->speeds2, factor);
+
+  printf("Warm start:\t\t\t\t%dx%d lattice, accel %.4f, %d steps (%s), av velocity %.6E, %.6lf (s)\n",
+         coarse.nx, coarse.ny, coarse.accel, steps, steps < coarse.maxIters ? "converged" : "not converged",
+         av_vel / factor, monotonic_clock() - tic);
+
+  converge_free(&converge);
+  finalise(&coarse, &coarse_cells, &coarse_tmp_cells, &coarse_obstacles, &coarse_av_vels);
+}